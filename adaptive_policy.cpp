@@ -0,0 +1,37 @@
+#include "adaptive_policy.h"
+#include "search_thread_pool.h"
+
+size_t AdaptivePolicy::SelectThreadCount(size_t posting_count) const
+{
+	size_t thread_count = 1;
+
+	for(const auto& [threads, min_postings] : search_levels)
+	{
+		if(posting_count < min_postings)
+		{
+			break;
+		}
+
+		thread_count = threads;
+	}
+
+	return thread_count;
+}
+
+bool AdaptivePolicy::ShouldMatchInParallel(size_t document_word_count) const
+{
+	return document_word_count >= min_parallel_match_words;
+}
+
+std::vector<std::pair<size_t, size_t>> AdaptivePolicy::DefaultSearchLevels()
+{
+	constexpr size_t POSTINGS_PER_THREAD = 32768;
+	std::vector<std::pair<size_t, size_t>> levels;
+
+	for(size_t threads = 2; threads <= SearchThreadPool::DefaultThreadCount(); threads *= 2)
+	{
+		levels.emplace_back(threads, threads * POSTINGS_PER_THREAD);
+	}
+
+	return levels;
+}
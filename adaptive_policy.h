@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Execution policy for FindTopDocuments and MatchDocument that decides per call. A search
+// is estimated by the postings of its plus words and a match by the words of the document;
+// small estimates run sequentially, where TBB task startup and ConcurrentMap locking would
+// cost more than they save, and larger ones on as many SearchThreadPool workers as the
+// work pays for. The default thresholds are rough; SearchServer::CalibrateAdaptivePolicy
+// measures them on the server's own index and this machine.
+struct AdaptivePolicy
+{
+	inline static constexpr size_t NEVER = std::numeric_limits<size_t>::max();
+
+	// (thread count, least postings worth it), both ascending.
+	std::vector<std::pair<size_t, size_t>> search_levels = DefaultSearchLevels();
+	// Least document words for which the parallel MatchDocument is faster.
+	size_t min_parallel_match_words = 4096;
+
+	// Workers for a search that reads posting_count postings; 1 means sequential.
+	size_t SelectThreadCount(size_t posting_count) const;
+
+	bool ShouldMatchInParallel(size_t document_word_count) const;
+
+	// Doubling thread counts up to SearchThreadPool::DefaultThreadCount(), each once 32768
+	// more postings per thread are read.
+	static std::vector<std::pair<size_t, size_t>> DefaultSearchLevels();
+};
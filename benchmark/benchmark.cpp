@@ -0,0 +1,398 @@
+#include <cstdlib>
+#include <execution>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "benchmark_runner.h"
+#include "concurrent_index_builder.h"
+#include "generators.h"
+#include "process_queries.h"
+#include "search_server.h"
+#include "string_processing.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	struct BenchmarkOptions
+	{
+		int document_count = 10'000;
+		int document_word_count = 70;
+		int dictionary_size = 1'000;
+		int max_word_length = 10;
+		int query_count = 100;
+		int query_word_count = 70;
+		double minus_rate = 0.1;
+		double duplicate_rate = 0.1;
+		unsigned seed = 5489u;
+		int warmup_iterations = 1;
+		int iterations = 5;
+		std::string filter;
+		std::string json_path;
+	};
+
+	void PrintUsage()
+	{
+		std::cout << "usage: search_server_benchmark [options]\n"
+				  << "  --documents N --document-words N --dictionary N --max-word-length N\n"
+				  << "  --queries N --query-words N --minus-rate P --duplicate-rate P --seed N\n"
+				  << "  --warmup N --iterations N --filter SUBSTRING --json PATH\n"
+				  << "search_server_benchmark --compare BASELINE.json CURRENT.json [--threshold 0.1]\n";
+	}
+
+	int Compare(const std::string& baseline_path, const std::string& current_path, double threshold)
+	{
+		const auto read_file = [](const std::string& path)
+		{
+			std::ifstream input(path);
+
+			if(!input)
+			{
+				throw std::runtime_error("cannot read "s + path);
+			}
+
+			std::ostringstream content;
+			content << input.rdbuf();
+			return content.str();
+		};
+
+		const auto comparisons = CompareBenchmarkResults(ParseBenchmarkResultsJson(read_file(baseline_path)),
+														 ParseBenchmarkResultsJson(read_file(current_path)), threshold);
+		bool has_regression = false;
+
+		std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(14) << "baseline p50" << std::setw(14) << "current p50"
+				  << std::setw(10) << "ratio" << '\n';
+
+		for(const auto& comparison : comparisons)
+		{
+			std::cout << std::left << std::setw(28) << comparison.name << std::right << std::fixed << std::setprecision(3)
+					  << std::setw(14) << comparison.baseline_p50_ms << std::setw(14) << comparison.current_p50_ms
+					  << std::setw(10) << comparison.ratio << (comparison.is_regression ? "  REGRESSION" : "") << '\n';
+			has_regression = has_regression || comparison.is_regression;
+		}
+
+		return has_regression ? 1 : 0;
+	}
+
+	void FillServer(SearchServer& search_server, const std::vector<std::string>& documents)
+	{
+		for(size_t i = 0; i < documents.size(); ++i)
+		{
+			search_server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+		}
+	}
+
+	int RunBenchmarks(const BenchmarkOptions& options)
+	{
+		std::mt19937 generator(options.seed);
+
+		const auto dictionary = GenerateDictionary(generator, options.dictionary_size, options.max_word_length);
+		auto documents = GenerateQueries(generator, dictionary, options.document_count, options.document_word_count);
+		const auto queries = GenerateQueries(generator, dictionary, options.query_count, options.query_word_count);
+		const std::string match_query = GenerateQuery(generator, dictionary, options.query_word_count, options.minus_rate);
+
+		// Same queries with every plus word misspellable by one edit.
+		std::vector<std::string> fuzzy_queries;
+		fuzzy_queries.reserve(queries.size());
+
+		for(const auto& query : queries)
+		{
+			std::string fuzzy_query;
+
+			for(const auto word : SplitIntoWords(query))
+			{
+				if(word.empty())
+				{
+					continue;
+				}
+
+				fuzzy_query += fuzzy_query.empty() ? "" : " ";
+				fuzzy_query += word;
+				fuzzy_query += word[0] == '-' ? "" : "~1";
+			}
+
+			fuzzy_queries.push_back(std::move(fuzzy_query));
+		}
+
+		// Give GetDuplicatedIds something to find.
+		for(size_t i = 1; i < documents.size(); ++i)
+		{
+			if(std::uniform_real_distribution<>(0, 1)(generator) < options.duplicate_rate)
+			{
+				documents[i] = documents[std::uniform_int_distribution<size_t>(0, i - 1)(generator)];
+			}
+		}
+
+		const std::string stop_words = dictionary[0];
+
+		SearchServer search_server(stop_words);
+		FillServer(search_server, documents);
+
+		SearchServer impact_server(stop_words);
+		FillServer(impact_server, documents);
+		impact_server.BuildImpactIndex();
+
+		SearchServer impact_ordered_server(stop_words);
+		FillServer(impact_ordered_server, documents);
+		impact_ordered_server.BuildImpactIndex(ImpactLayout::IMPACT_ORDERED);
+
+		std::optional<SearchServer> scratch_server;
+		const auto rebuild_scratch_server = [&]
+		{
+			scratch_server.reset();
+			scratch_server.emplace(stop_words);
+			FillServer(*scratch_server, documents);
+		};
+
+		const AdaptivePolicy adaptive_policy = search_server.CalibrateAdaptivePolicy();
+
+		double sink = 0;
+
+		const auto find_top = [&](auto policy)
+		{
+			return [&, policy]
+			{
+				for(const auto& query : queries)
+				{
+					for(const auto& document : search_server.FindTopDocuments(policy, query))
+					{
+						sink += document.relevance;
+					}
+				}
+			};
+		};
+
+		const auto find_impact = [&](const SearchServer& server)
+		{
+			return [&, server = &server]
+			{
+				for(const auto& query : queries)
+				{
+					for(const auto& document : server->FindTopDocuments(query))
+					{
+						sink += document.relevance;
+					}
+				}
+			};
+		};
+
+		const auto find_all_words = [&](const SearchServer& server)
+		{
+			return [&, server = &server]
+			{
+				SearchOptions all_words;
+				all_words.match_mode = MatchMode::ALL;
+
+				for(const auto& query : queries)
+				{
+					for(const auto& document : server->FindTopDocuments(std::execution::seq, query, [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; }, all_words))
+					{
+						sink += document.relevance;
+					}
+				}
+			};
+		};
+
+		const auto find_fuzzy = [&]
+		{
+			for(const auto& query : fuzzy_queries)
+			{
+				for(const auto& document : search_server.FindTopDocuments(query))
+				{
+					sink += document.relevance;
+				}
+			}
+		};
+
+		const auto match = [&](auto policy)
+		{
+			return [&, policy]
+			{
+				for(const int document_id : search_server)
+				{
+					sink += std::get<0>(search_server.MatchDocument(policy, match_query, document_id)).size();
+				}
+			};
+		};
+
+		const auto remove = [&](auto policy)
+		{
+			return [&, policy]
+			{
+				for(size_t id = 0; id < documents.size(); ++id)
+				{
+					scratch_server->RemoveDocument(policy, static_cast<int>(id));
+				}
+			};
+		};
+
+		// Every producer thread adds its own stride of the documents through one builder.
+		const auto add_concurrent = [&]
+		{
+			SearchServer server(stop_words);
+
+			{
+				ConcurrentIndexBuilder builder(server);
+				const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+				std::vector<std::thread> producers;
+
+				for(size_t t = 0; t < thread_count; ++t)
+				{
+					producers.emplace_back([&, t]
+					{
+						for(size_t i = t; i < documents.size(); i += thread_count)
+						{
+							builder.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+						}
+					});
+				}
+
+				for(auto& producer : producers)
+				{
+					producer.join();
+				}
+			}
+
+			sink += server.GetDocumentCount();
+		};
+
+		const std::vector<BenchmarkCase> benchmarks = {
+			{"AddDocument"s, nullptr, [&] { SearchServer server(stop_words); FillServer(server, documents); sink += server.GetDocumentCount(); }},
+			{"AddDocument/concurrent"s, nullptr, add_concurrent},
+			{"FindTopDocuments/seq"s, nullptr, find_top(std::execution::seq)},
+			{"FindTopDocuments/par"s, nullptr, find_top(std::execution::par)},
+			{"FindTopDocuments/adaptive"s, nullptr, find_top(adaptive_policy)},
+			{"FindTopDocuments/fuzzy"s, nullptr, find_fuzzy},
+			{"FindTopDocuments/impact"s, nullptr, find_impact(impact_server)},
+			{"FindTopDocuments/impact-ordered"s, nullptr, find_impact(impact_ordered_server)},
+			{"FindTopDocuments/all-words"s, nullptr, find_all_words(search_server)},
+			{"FindTopDocuments/all-words-impact"s, nullptr, find_all_words(impact_server)},
+			{"MatchDocument/seq"s, nullptr, match(std::execution::seq)},
+			{"MatchDocument/par"s, nullptr, match(std::execution::par)},
+			{"MatchDocument/adaptive"s, nullptr, match(adaptive_policy)},
+			{"RemoveDocument/seq"s, rebuild_scratch_server, remove(std::execution::seq)},
+			{"RemoveDocument/par"s, rebuild_scratch_server, remove(std::execution::par)},
+			{"GetDuplicatedIds"s, nullptr, [&] { sink += search_server.GetDuplicatedIds().size(); }},
+			{"ProcessQueries"s, nullptr, [&] { sink += ProcessQueries(search_server, queries).size(); }},
+		};
+
+		const BenchmarkRunner runner(options.warmup_iterations, options.iterations);
+		std::vector<BenchmarkResult> results;
+
+		std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(8) << "iters"
+				  << std::setw(12) << "mean ms" << std::setw(12) << "p50 ms" << std::setw(12) << "p90 ms"
+				  << std::setw(12) << "p99 ms" << std::setw(12) << "max ms" << '\n';
+
+		for(const auto& benchmark : benchmarks)
+		{
+			if(!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos)
+			{
+				continue;
+			}
+
+			const BenchmarkResult result = runner.Run(benchmark);
+			results.push_back(result);
+
+			std::cout << std::left << std::setw(28) << result.name << std::right << std::setw(8) << result.iterations
+					  << std::fixed << std::setprecision(3) << std::setw(12) << result.mean_ms << std::setw(12) << result.p50_ms
+					  << std::setw(12) << result.p90_ms << std::setw(12) << result.p99_ms << std::setw(12) << result.max_ms << std::endl;
+		}
+
+		if(!options.json_path.empty())
+		{
+			const std::map<std::string, std::string> parameters = {
+				{"documents"s, std::to_string(options.document_count)},
+				{"document_words"s, std::to_string(options.document_word_count)},
+				{"dictionary"s, std::to_string(options.dictionary_size)},
+				{"max_word_length"s, std::to_string(options.max_word_length)},
+				{"queries"s, std::to_string(options.query_count)},
+				{"query_words"s, std::to_string(options.query_word_count)},
+				{"minus_rate"s, std::to_string(options.minus_rate)},
+				{"duplicate_rate"s, std::to_string(options.duplicate_rate)},
+				{"seed"s, std::to_string(options.seed)},
+				{"warmup"s, std::to_string(options.warmup_iterations)},
+				{"iterations"s, std::to_string(options.iterations)},
+			};
+
+			std::ofstream output(options.json_path);
+			output << BenchmarkResultsToJson(parameters, results);
+		}
+
+		const LatencyHistogram posting_lengths = search_server.GetPostingLengthHistogram();
+		std::cout << "\nindex memory (bytes):\n" << search_server.MemoryUsage().ToText()
+				  << "posting length p50/p99/max: " << posting_lengths.GetPercentile(50) << '/' << posting_lengths.GetPercentile(99)
+				  << '/' << posting_lengths.GetMax() << '\n';
+
+		// Keeps the optimizer from discarding the measured work.
+		std::cerr << "checksum: " << sink << std::endl;
+
+		return 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+	std::vector<std::string> compare_paths;
+	double threshold = 0.1;
+
+	try
+	{
+		for(int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const auto next = [&]() -> std::string
+			{
+				if(i + 1 >= argc)
+				{
+					throw std::invalid_argument("missing value for "s + arg);
+				}
+				return argv[++i];
+			};
+
+			if(arg == "--documents") options.document_count = std::stoi(next());
+			else if(arg == "--document-words") options.document_word_count = std::stoi(next());
+			else if(arg == "--dictionary") options.dictionary_size = std::stoi(next());
+			else if(arg == "--max-word-length") options.max_word_length = std::stoi(next());
+			else if(arg == "--queries") options.query_count = std::stoi(next());
+			else if(arg == "--query-words") options.query_word_count = std::stoi(next());
+			else if(arg == "--minus-rate") options.minus_rate = std::stod(next());
+			else if(arg == "--duplicate-rate") options.duplicate_rate = std::stod(next());
+			else if(arg == "--seed") options.seed = static_cast<unsigned>(std::stoul(next()));
+			else if(arg == "--warmup") options.warmup_iterations = std::stoi(next());
+			else if(arg == "--iterations") options.iterations = std::stoi(next());
+			else if(arg == "--filter") options.filter = next();
+			else if(arg == "--json") options.json_path = next();
+			else if(arg == "--threshold") threshold = std::stod(next());
+			else if(arg == "--compare")
+			{
+				compare_paths.push_back(next());
+				compare_paths.push_back(next());
+			}
+			else
+			{
+				PrintUsage();
+				return arg == "--help" ? 0 : 2;
+			}
+		}
+
+		if(!compare_paths.empty())
+		{
+			return Compare(compare_paths[0], compare_paths[1], threshold);
+		}
+
+		return RunBenchmarks(options);
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << std::endl;
+		return 2;
+	}
+}
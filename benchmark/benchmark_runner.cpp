@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include "benchmark_runner.h"
+
+namespace
+{
+	double NearestRank(const std::vector<double>& sorted, double percentile)
+	{
+		const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size()));
+		return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	}
+}
+
+BenchmarkRunner::BenchmarkRunner(int warmup_iterations, int iterations)
+	: warmup_iterations_(warmup_iterations), iterations_(iterations)
+{
+	if(warmup_iterations < 0 || iterations <= 0)
+	{
+		throw std::invalid_argument("benchmark needs a non-negative warmup and at least one iteration");
+	}
+}
+
+BenchmarkResult BenchmarkRunner::Run(const BenchmarkCase& benchmark) const
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::vector<double> samples_ms;
+	samples_ms.reserve(iterations_);
+
+	for(int i = 0; i < warmup_iterations_ + iterations_; ++i)
+	{
+		if(benchmark.setup)
+		{
+			benchmark.setup();
+		}
+
+		const Clock::time_point start = Clock::now();
+		benchmark.run();
+		const Clock::time_point finish = Clock::now();
+
+		if(i >= warmup_iterations_)
+		{
+			samples_ms.push_back(std::chrono::duration<double, std::milli>(finish - start).count());
+		}
+	}
+
+	return SummarizeSamples(benchmark.name, std::move(samples_ms));
+}
+
+BenchmarkResult SummarizeSamples(const std::string& name, std::vector<double> samples_ms)
+{
+	BenchmarkResult result;
+	result.name = name;
+	result.iterations = samples_ms.size();
+
+	if(samples_ms.empty())
+	{
+		return result;
+	}
+
+	std::sort(samples_ms.begin(), samples_ms.end());
+
+	result.mean_ms = std::accumulate(samples_ms.begin(), samples_ms.end(), 0.0) / samples_ms.size();
+	result.min_ms = samples_ms.front();
+	result.p50_ms = NearestRank(samples_ms, 50);
+	result.p90_ms = NearestRank(samples_ms, 90);
+	result.p99_ms = NearestRank(samples_ms, 99);
+	result.max_ms = samples_ms.back();
+
+	return result;
+}
+
+std::string BenchmarkResultsToJson(const std::map<std::string, std::string>& parameters, const std::vector<BenchmarkResult>& results)
+{
+	std::ostringstream out;
+	out.precision(6);
+	out << std::fixed;
+
+	out << "{\n  \"parameters\": {";
+	bool is_first = true;
+
+	for(const auto& [key, value] : parameters)
+	{
+		out << (is_first ? "" : ", ") << '"' << key << "\": \"" << value << '"';
+		is_first = false;
+	}
+
+	out << "},\n  \"benchmarks\": [\n";
+
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& result = results[i];
+		out << "    {\"name\":\"" << result.name << "\",\"iterations\":" << result.iterations
+			<< ",\"mean_ms\":" << result.mean_ms << ",\"min_ms\":" << result.min_ms
+			<< ",\"p50_ms\":" << result.p50_ms << ",\"p90_ms\":" << result.p90_ms
+			<< ",\"p99_ms\":" << result.p99_ms << ",\"max_ms\":" << result.max_ms << '}'
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	out << "  ]\n}\n";
+	return out.str();
+}
+
+std::vector<BenchmarkResult> ParseBenchmarkResultsJson(const std::string& json)
+{
+	// Reads back exactly what BenchmarkResultsToJson writes: flat benchmark objects with numeric fields.
+	static const std::regex benchmark_pattern(R"xx(\{"name":"([^"]*)"([^}]*)\})xx");
+	static const std::regex field_pattern(R"xx("(\w+)":([-+0-9.eE]+))xx");
+
+	std::vector<BenchmarkResult> results;
+
+	for(auto it = std::sregex_iterator(json.begin(), json.end(), benchmark_pattern); it != std::sregex_iterator(); ++it)
+	{
+		BenchmarkResult result;
+		result.name = (*it)[1];
+		const std::string fields = (*it)[2];
+
+		for(auto field = std::sregex_iterator(fields.begin(), fields.end(), field_pattern); field != std::sregex_iterator(); ++field)
+		{
+			const std::string key = (*field)[1];
+			const double value = std::stod((*field)[2]);
+
+			if(key == "iterations") result.iterations = static_cast<size_t>(value);
+			else if(key == "mean_ms") result.mean_ms = value;
+			else if(key == "min_ms") result.min_ms = value;
+			else if(key == "p50_ms") result.p50_ms = value;
+			else if(key == "p90_ms") result.p90_ms = value;
+			else if(key == "p99_ms") result.p99_ms = value;
+			else if(key == "max_ms") result.max_ms = value;
+		}
+
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+std::vector<BenchmarkComparison> CompareBenchmarkResults(const std::vector<BenchmarkResult>& baseline,
+														 const std::vector<BenchmarkResult>& current, double threshold)
+{
+	std::vector<BenchmarkComparison> comparisons;
+
+	for(const BenchmarkResult& result : current)
+	{
+		const auto base = std::find_if(baseline.begin(), baseline.end(), [&result](const BenchmarkResult& item) { return item.name == result.name; });
+
+		if(base == baseline.end())
+		{
+			continue;
+		}
+
+		BenchmarkComparison comparison;
+		comparison.name = result.name;
+		comparison.baseline_p50_ms = base->p50_ms;
+		comparison.current_p50_ms = result.p50_ms;
+		comparison.ratio = base->p50_ms > 0 ? result.p50_ms / base->p50_ms : 1.0;
+		comparison.is_regression = comparison.ratio > 1.0 + threshold;
+
+		comparisons.push_back(comparison);
+	}
+
+	return comparisons;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BenchmarkCase
+{
+	std::string name;
+	// Runs before every iteration (warmup included) and is not timed.
+	std::function<void()> setup;
+	std::function<void()> run;
+};
+
+struct BenchmarkResult
+{
+	std::string name;
+	size_t iterations = 0;
+	double mean_ms = 0;
+	double min_ms = 0;
+	double p50_ms = 0;
+	double p90_ms = 0;
+	double p99_ms = 0;
+	double max_ms = 0;
+};
+
+struct BenchmarkComparison
+{
+	std::string name;
+	double baseline_p50_ms = 0;
+	double current_p50_ms = 0;
+	double ratio = 0;
+	bool is_regression = false;
+};
+
+class BenchmarkRunner
+{
+public:
+	BenchmarkRunner(int warmup_iterations, int iterations);
+
+	BenchmarkResult Run(const BenchmarkCase& benchmark) const;
+
+private:
+	int warmup_iterations_;
+	int iterations_;
+};
+
+BenchmarkResult SummarizeSamples(const std::string& name, std::vector<double> samples_ms);
+
+std::string BenchmarkResultsToJson(const std::map<std::string, std::string>& parameters, const std::vector<BenchmarkResult>& results);
+
+std::vector<BenchmarkResult> ParseBenchmarkResultsJson(const std::string& json);
+
+// A benchmark regresses when its median got slower than baseline by more than threshold (0.1 = 10%).
+std::vector<BenchmarkComparison> CompareBenchmarkResults(const std::vector<BenchmarkResult>& baseline,
+														 const std::vector<BenchmarkResult>& current, double threshold);
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "metrics.h"
+#include "search_server.h"
+#include "workload.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	struct LoadOptions
+	{
+		WorkloadOptions workload;
+		std::string query_log;
+		std::string write_query_log;
+		int threads = 4;
+		double target_qps = 0;
+		int repeat = 1;
+	};
+
+	void PrintUsage()
+	{
+		std::cout << "usage: search_server_load_tester [options]\n"
+				  << "  corpus:  --documents N --vocabulary N --term-exponent S --doc-length-median N --doc-length-sigma S\n"
+				  << "  queries: --queries N --query-length-mean N --query-exponent S --minus-rate P --seed N\n"
+				  << "           --query-log PATH (replay instead of generating) --write-query-log PATH\n"
+				  << "  load:    --threads N --qps N (0 = as fast as possible) --repeat N\n";
+	}
+
+	void PrintLatencies(const std::string& title, const LatencyHistogram& histogram)
+	{
+		const auto ms = [](uint64_t ns) { return ns / 1e6; };
+
+		std::cout << std::left << std::setw(16) << title << std::right << std::fixed << std::setprecision(3)
+				  << " mean " << ms(static_cast<uint64_t>(histogram.GetMean())) << " ms"
+				  << "  p50 " << ms(histogram.GetPercentile(50)) << " ms"
+				  << "  p90 " << ms(histogram.GetPercentile(90)) << " ms"
+				  << "  p99 " << ms(histogram.GetPercentile(99)) << " ms"
+				  << "  p99.9 " << ms(histogram.GetPercentile(99.9)) << " ms"
+				  << "  max " << ms(histogram.GetMax()) << " ms" << '\n';
+	}
+
+	int Run(const LoadOptions& options)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		const Workload workload = GenerateWorkload(options.workload);
+		const std::vector<std::string> queries = options.query_log.empty() ? workload.queries : ReadQueryLog(options.query_log);
+
+		if(!options.write_query_log.empty())
+		{
+			WriteQueryLog(options.write_query_log, queries);
+		}
+
+		if(queries.empty())
+		{
+			throw std::invalid_argument("no queries to replay");
+		}
+
+		SearchServer search_server;
+
+		{
+			const Clock::time_point start = Clock::now();
+
+			for(size_t i = 0; i < workload.documents.size(); ++i)
+			{
+				search_server.AddDocument(static_cast<int>(i), workload.documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+			}
+
+			std::cout << "indexed " << workload.documents.size() << " documents in "
+					  << std::chrono::duration<double>(Clock::now() - start).count() << " s\n";
+		}
+
+		const size_t total = queries.size() * static_cast<size_t>(options.repeat);
+		const int thread_count = std::max(options.threads, 1);
+
+		std::atomic<size_t> next_query{0};
+		std::atomic<size_t> failed{0};
+		std::vector<LatencyHistogram> service_times(thread_count);
+		std::vector<LatencyHistogram> response_times(thread_count);
+
+		const Clock::time_point start = Clock::now();
+
+		// Open loop: query i is due at start + i / qps no matter how earlier queries fared, and its
+		// response time counts from that moment, so a stalled server shows up as queueing delay.
+		const auto client = [&](int thread_index)
+		{
+			while(true)
+			{
+				const size_t index = next_query.fetch_add(1, std::memory_order_relaxed);
+
+				if(index >= total)
+				{
+					return;
+				}
+
+				Clock::time_point due = Clock::now();
+
+				if(options.target_qps > 0)
+				{
+					due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(index / options.target_qps));
+					std::this_thread::sleep_until(due);
+				}
+
+				const Clock::time_point begin = Clock::now();
+
+				try
+				{
+					search_server.FindTopDocuments(queries[index % queries.size()]);
+				}
+				catch(const std::exception&)
+				{
+					failed.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				const Clock::time_point end = Clock::now();
+				service_times[thread_index].Record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+				response_times[thread_index].Record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - std::min(due, begin)).count());
+			}
+		};
+
+		std::vector<std::thread> clients;
+
+		for(int i = 0; i < thread_count; ++i)
+		{
+			clients.emplace_back(client, i);
+		}
+
+		for(auto& thread : clients)
+		{
+			thread.join();
+		}
+
+		const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+		LatencyHistogram service_time;
+		LatencyHistogram response_time;
+
+		for(int i = 0; i < thread_count; ++i)
+		{
+			service_time.Merge(service_times[i]);
+			response_time.Merge(response_times[i]);
+		}
+
+		std::cout << "queries " << total << " (" << failed.load() << " failed) with " << thread_count << " threads in "
+				  << std::fixed << std::setprecision(3) << elapsed << " s: " << total / elapsed << " qps";
+
+		if(options.target_qps > 0)
+		{
+			std::cout << " (target " << options.target_qps << ")";
+		}
+
+		std::cout << '\n';
+		PrintLatencies("service time", service_time);
+		PrintLatencies("response time", response_time);
+
+		return 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	LoadOptions options;
+
+	try
+	{
+		for(int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const auto next = [&]() -> std::string
+			{
+				if(i + 1 >= argc)
+				{
+					throw std::invalid_argument("missing value for "s + arg);
+				}
+				return argv[++i];
+			};
+
+			if(arg == "--documents") options.workload.document_count = std::stoi(next());
+			else if(arg == "--vocabulary") options.workload.vocabulary_size = std::stoi(next());
+			else if(arg == "--term-exponent") options.workload.term_exponent = std::stod(next());
+			else if(arg == "--doc-length-median") options.workload.document_length_median = std::stod(next());
+			else if(arg == "--doc-length-sigma") options.workload.document_length_sigma = std::stod(next());
+			else if(arg == "--queries") options.workload.query_count = std::stoi(next());
+			else if(arg == "--query-length-mean") options.workload.query_length_mean = std::stod(next());
+			else if(arg == "--query-exponent") options.workload.query_term_exponent = std::stod(next());
+			else if(arg == "--minus-rate") options.workload.minus_rate = std::stod(next());
+			else if(arg == "--seed") options.workload.seed = static_cast<unsigned>(std::stoul(next()));
+			else if(arg == "--query-log") options.query_log = next();
+			else if(arg == "--write-query-log") options.write_query_log = next();
+			else if(arg == "--threads") options.threads = std::stoi(next());
+			else if(arg == "--qps") options.target_qps = std::stod(next());
+			else if(arg == "--repeat") options.repeat = std::stoi(next());
+			else
+			{
+				PrintUsage();
+				return arg == "--help" ? 0 : 2;
+			}
+		}
+
+		return Run(options);
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << std::endl;
+		return 2;
+	}
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+#include "workload.h"
+#include "generators.h"
+
+ZipfDistribution::ZipfDistribution(size_t n, double exponent) : cumulative_(n)
+{
+	if(n == 0)
+	{
+		throw std::invalid_argument("Zipf distribution needs at least one rank");
+	}
+
+	double sum = 0;
+
+	for(size_t rank = 0; rank < n; ++rank)
+	{
+		sum += 1.0 / std::pow(rank + 1.0, exponent);
+		cumulative_[rank] = sum;
+	}
+
+	for(double& value : cumulative_)
+	{
+		value /= sum;
+	}
+}
+
+size_t ZipfDistribution::operator()(std::mt19937& generator) const
+{
+	const double point = std::uniform_real_distribution<>(0, 1)(generator);
+	const auto it = std::upper_bound(cumulative_.begin(), cumulative_.end(), point);
+
+	return std::min<size_t>(it - cumulative_.begin(), cumulative_.size() - 1);
+}
+
+namespace
+{
+	std::vector<std::string> GenerateVocabulary(std::mt19937& generator, int size, int max_word_length)
+	{
+		std::unordered_set<std::string> seen;
+		std::vector<std::string> vocabulary;
+		vocabulary.reserve(size);
+
+		// Random words repeat for short lengths; give up growing after enough misses instead of looping forever.
+		for(int misses = 0; static_cast<int>(vocabulary.size()) < size && misses < size * 10;)
+		{
+			std::string word = GenerateWord(generator, max_word_length);
+
+			if(seen.insert(word).second)
+			{
+				vocabulary.push_back(std::move(word));
+			}
+			else
+			{
+				++misses;
+			}
+		}
+
+		return vocabulary;
+	}
+}
+
+Workload GenerateWorkload(const WorkloadOptions& options)
+{
+	std::mt19937 generator(options.seed);
+	Workload workload;
+
+	workload.vocabulary = GenerateVocabulary(generator, options.vocabulary_size, options.max_word_length);
+
+	const ZipfDistribution document_terms(workload.vocabulary.size(), options.term_exponent);
+	const ZipfDistribution query_terms(workload.vocabulary.size(), options.query_term_exponent);
+	std::lognormal_distribution<> document_length(std::log(options.document_length_median), options.document_length_sigma);
+	std::poisson_distribution<> query_length(std::max(options.query_length_mean - 1, 0.0));
+	std::uniform_real_distribution<> unit(0, 1);
+
+	workload.documents.reserve(options.document_count);
+
+	for(int i = 0; i < options.document_count; ++i)
+	{
+		const int length = std::clamp(static_cast<int>(std::lround(document_length(generator))), 1, options.max_document_length);
+		std::string document;
+
+		for(int j = 0; j < length; ++j)
+		{
+			if(j != 0)
+			{
+				document.push_back(' ');
+			}
+			document += workload.vocabulary[document_terms(generator)];
+		}
+
+		workload.documents.push_back(std::move(document));
+	}
+
+	workload.queries.reserve(options.query_count);
+
+	for(int i = 0; i < options.query_count; ++i)
+	{
+		const int length = std::min(1 + query_length(generator), options.max_query_length);
+		std::string query;
+
+		for(int j = 0; j < length; ++j)
+		{
+			if(j != 0)
+			{
+				query.push_back(' ');
+			}
+			// The first word always stays a plus word so the query can match something.
+			if(j != 0 && unit(generator) < options.minus_rate)
+			{
+				query.push_back('-');
+			}
+			query += workload.vocabulary[query_terms(generator)];
+		}
+
+		workload.queries.push_back(std::move(query));
+	}
+
+	return workload;
+}
+
+std::vector<std::string> ReadQueryLog(const std::string& path)
+{
+	std::ifstream input(path);
+
+	if(!input)
+	{
+		throw std::runtime_error("cannot read query log " + path);
+	}
+
+	std::vector<std::string> queries;
+
+	for(std::string line; std::getline(input, line);)
+	{
+		if(!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if(!line.empty())
+		{
+			queries.push_back(std::move(line));
+		}
+	}
+
+	return queries;
+}
+
+void WriteQueryLog(const std::string& path, const std::vector<std::string>& queries)
+{
+	std::ofstream output(path);
+
+	if(!output)
+	{
+		throw std::runtime_error("cannot write query log " + path);
+	}
+
+	for(const auto& query : queries)
+	{
+		output << query << '\n';
+	}
+}
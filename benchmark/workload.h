@@ -0,0 +1,51 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^exponent.
+class ZipfDistribution
+{
+public:
+	ZipfDistribution(size_t n, double exponent);
+
+	size_t operator()(std::mt19937& generator) const;
+
+private:
+	std::vector<double> cumulative_;
+};
+
+struct WorkloadOptions
+{
+	int vocabulary_size = 50'000;
+	int max_word_length = 10;
+	double term_exponent = 1.0;
+
+	int document_count = 10'000;
+	// Document lengths are log-normal: the median length and the spread of its logarithm.
+	double document_length_median = 60;
+	double document_length_sigma = 0.8;
+	int max_document_length = 2'000;
+
+	int query_count = 10'000;
+	double query_length_mean = 3;
+	int max_query_length = 16;
+	double query_term_exponent = 1.0;
+	double minus_rate = 0.05;
+
+	unsigned seed = 5489u;
+};
+
+struct Workload
+{
+	std::vector<std::string> vocabulary;
+	std::vector<std::string> documents;
+	std::vector<std::string> queries;
+};
+
+Workload GenerateWorkload(const WorkloadOptions& options);
+
+// One query per line.
+std::vector<std::string> ReadQueryLog(const std::string& path);
+void WriteQueryLog(const std::string& path, const std::vector<std::string>& queries);
@@ -0,0 +1,179 @@
+#include <stdexcept>
+#include <thread>
+#include "concurrent_index_builder.h"
+
+ConcurrentIndexBuilder::ConcurrentIndexBuilder(SearchServer& search_server, size_t batch_size)
+	: search_server_(search_server), batch_size_(std::max<size_t>(batch_size, 1)), claimed_ids_(search_server.begin(), search_server.end())
+{
+}
+
+ConcurrentIndexBuilder::~ConcurrentIndexBuilder()
+{
+	// Buffered documents refer to the term table, which dies with the builder.
+	Flush();
+}
+
+void ConcurrentIndexBuilder::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings, bool index_positions)
+{
+	if(document_id < 0)
+	{
+		throw std::invalid_argument("document id is less than zero");
+	}
+
+	auto prepared = search_server_.PrepareDocument(document_id, document, status, ratings, index_positions);
+
+	{
+		const std::lock_guard lock(ids_mutex_);
+
+		if(!claimed_ids_.insert(document_id).second)
+		{
+			throw std::invalid_argument("duplicate document id { id = " + std::to_string(document_id) + " }");
+		}
+	}
+
+	// The prepared words view the caller's text; publishing replaces them with the server's.
+	std::vector<Term*> terms;
+	terms.reserve(prepared.word_counts.size() + prepared.word_positions.size());
+	std::vector<std::pair<Term*, double>> term_freqs;
+	term_freqs.reserve(prepared.word_counts.size());
+
+	for(const auto& [word, count] : prepared.word_counts)
+	{
+		Term* term = FindTerm(word);
+		terms.push_back(term);
+		term_freqs.emplace_back(term, SearchServer::ComputeTermFrequency(count, prepared.length));
+	}
+
+	for(const auto& [word, position] : prepared.word_positions)
+	{
+		terms.push_back(FindTerm(word));
+	}
+
+	Batch batch;
+
+	{
+		Buffer& buffer = GetThreadBuffer();
+		const std::lock_guard lock(buffer.mutex);
+
+		for(const auto& [term, term_freq] : term_freqs)
+		{
+			buffer.batch.postings[term].emplace_back(document_id, term_freq);
+		}
+
+		buffer.batch.documents.push_back(std::move(prepared));
+		buffer.batch.document_terms.push_back(std::move(terms));
+
+		if(buffer.batch.documents.size() >= batch_size_)
+		{
+			std::swap(batch, buffer.batch);
+		}
+	}
+
+	if(!batch.documents.empty())
+	{
+		Publish(batch);
+	}
+}
+
+void ConcurrentIndexBuilder::Flush()
+{
+	for(Buffer& buffer : buffers_)
+	{
+		Batch batch;
+
+		{
+			const std::lock_guard lock(buffer.mutex);
+			std::swap(batch, buffer.batch);
+		}
+
+		if(!batch.documents.empty())
+		{
+			Publish(batch);
+		}
+	}
+}
+
+std::vector<int> ConcurrentIndexBuilder::GetRejectedIds() const
+{
+	const std::shared_lock lock(server_mutex_);
+	return rejected_ids_;
+}
+
+ConcurrentIndexBuilder::Term* ConcurrentIndexBuilder::FindTerm(std::string_view word)
+{
+	Stripe& stripe = stripes_[std::hash<std::string_view>{}(word) % STRIPE_COUNT];
+	const std::lock_guard lock(stripe.mutex);
+
+	const auto it = stripe.terms.find(word);
+
+	if(it != stripe.terms.end())
+	{
+		return it->second;
+	}
+
+	Term& term = stripe.storage.emplace_back();
+	term.word = word;
+	stripe.terms.emplace(term.word, &term);
+
+	return &term;
+}
+
+ConcurrentIndexBuilder::Buffer& ConcurrentIndexBuilder::GetThreadBuffer()
+{
+	return buffers_[std::hash<std::thread::id>{}(std::this_thread::get_id()) % BUFFER_COUNT];
+}
+
+void ConcurrentIndexBuilder::Publish(Batch& batch)
+{
+	const std::unique_lock lock(server_mutex_);
+
+	// A word is interned by the server the first time it is published, never again.
+	const auto resolve = [this](Term* term)
+	{
+		if(term->slot.postings == nullptr)
+		{
+			term->slot = search_server_.GetTermSlot(term->word);
+		}
+
+		return term->slot;
+	};
+
+	for(size_t i = 0; i < batch.documents.size(); ++i)
+	{
+		auto& document = batch.documents[i];
+		auto term = batch.document_terms[i].begin();
+
+		for(auto& [word, count] : document.word_counts)
+		{
+			word = resolve(*term++).word;
+		}
+
+		for(auto& [word, position] : document.word_positions)
+		{
+			word = resolve(*term++).word;
+		}
+	}
+
+	std::vector<SearchServer::TermPostings> postings;
+	postings.reserve(batch.postings.size());
+
+	for(auto& [term, term_postings] : batch.postings)
+	{
+		postings.push_back({resolve(term), std::move(term_postings)});
+	}
+
+	const std::vector<int> rejected_ids = search_server_.AddPreparedDocuments(std::execution::par, batch.documents, postings);
+
+	if(!rejected_ids.empty())
+	{
+		rejected_ids_.insert(rejected_ids_.end(), rejected_ids.begin(), rejected_ids.end());
+
+		// The ids never made it into the server, so they are free to be added again.
+		const std::lock_guard ids_lock(ids_mutex_);
+
+		for(const int document_id : rejected_ids)
+		{
+			claimed_ids_.erase(document_id);
+		}
+	}
+}
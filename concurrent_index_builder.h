@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "search_server.h"
+
+// Lets any number of ingest threads add documents to one server at once. Tokenizing, counting
+// and term frequencies run on the calling thread; each word is looked up once in a striped term
+// table that remembers the server's copy of the word and its posting list, and the postings
+// wait in per-thread buffers, grouped by term. A buffer is published every batch_size
+// documents: its documents are registered one by one and its terms are merged into their
+// posting lists in parallel. Searches go through Search, which runs alongside ingest but never
+// alongside a publish. The server must not be used directly while the builder is alive.
+class ConcurrentIndexBuilder
+{
+public:
+	inline static constexpr size_t STRIPE_COUNT = 64;
+	inline static constexpr size_t BUFFER_COUNT = 16;
+
+	explicit ConcurrentIndexBuilder(SearchServer& search_server, size_t batch_size = 256);
+	~ConcurrentIndexBuilder();
+
+	ConcurrentIndexBuilder(const ConcurrentIndexBuilder&) = delete;
+	ConcurrentIndexBuilder& operator=(const ConcurrentIndexBuilder&) = delete;
+
+	// Throws like SearchServer::AddDocument for bad ids and words. Documents the server
+	// rejects as duplicates only surface at indexing time, in GetRejectedIds; their ids
+	// are released and may be added again.
+	void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings, bool index_positions = false);
+
+	// Indexes every buffered document; the ones added before the call are searchable after it.
+	void Flush();
+
+	template<typename Function>
+	auto Search(Function function) const
+	{
+		const std::shared_lock lock(server_mutex_);
+		return function(static_cast<const SearchServer&>(search_server_));
+	}
+
+	std::vector<int> GetRejectedIds() const;
+
+private:
+	// A word some document has used. The slot is empty until the first publish that indexes
+	// the word and is only touched under the exclusive server lock.
+	struct Term
+	{
+		std::string word;
+		SearchServer::TermSlot slot;
+	};
+
+	struct Stripe
+	{
+		std::mutex mutex;
+		// Keys view Term::word; deque elements never move.
+		std::unordered_map<std::string_view, Term*> terms;
+		std::deque<Term> storage;
+	};
+
+	// Documents waiting to be published, with the terms of their word_counts followed by the
+	// terms of their word_positions, and the postings they add to each term.
+	struct Batch
+	{
+		std::vector<SearchServer::PreparedDocument> documents;
+		std::vector<std::vector<Term*>> document_terms;
+		std::unordered_map<Term*, std::vector<std::pair<int, double>>> postings;
+	};
+
+	struct Buffer
+	{
+		std::mutex mutex;
+		Batch batch;
+	};
+
+	SearchServer& search_server_;
+	const size_t batch_size_;
+
+	std::array<Stripe, STRIPE_COUNT> stripes_;
+	std::array<Buffer, BUFFER_COUNT> buffers_;
+
+	std::mutex ids_mutex_;
+	std::set<int> claimed_ids_;
+
+	mutable std::shared_mutex server_mutex_;
+	std::vector<int> rejected_ids_;
+
+	Term* FindTerm(std::string_view word);
+	Buffer& GetThreadBuffer();
+	void Publish(Batch& batch);
+};
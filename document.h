@@ -4,6 +4,8 @@
 #include <set>
 #include <vector>
 #include <unordered_set>
+#include <memory_resource>
+#include <string_view>
 
 enum class DocumentStatus
 {
@@ -28,7 +30,9 @@ struct DocumentData
 {
 	int rating;
 	DocumentStatus status;
-	std::unordered_set<std::string_view> words;
+	std::pmr::unordered_set<std::string_view> words;
+	// Number of indexed (non-stop) words, repeats included.
+	size_t length = 0;
 };
 
 std::ostream& operator<<(std::ostream& stream, const Document& document);
@@ -0,0 +1,50 @@
+#include "document_fingerprint.h"
+
+namespace
+{
+	uint64_t Mix64(uint64_t value)
+	{
+		value ^= value >> 30;
+		value *= 0xBF58476D1CE4E5B9ull;
+		value ^= value >> 27;
+		value *= 0x94D049BB133111EBull;
+		value ^= value >> 31;
+		return value;
+	}
+
+	uint64_t HashBytes(std::string_view word, uint64_t seed, uint64_t prime)
+	{
+		uint64_t hash = seed;
+
+		for(const char c : word)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= prime;
+		}
+
+		return Mix64(hash ^ word.size());
+	}
+}
+
+DocumentFingerprint ComputeWordFingerprint(std::string_view word)
+{
+	return {HashBytes(word, 0xCBF29CE484222325ull, 0x100000001B3ull), HashBytes(word, 0x84222325CBF29CE4ull, 0x880355F21E6D1965ull)};
+}
+
+DocumentFingerprint ComputeDocumentFingerprint(const std::pmr::unordered_set<std::string_view>& words)
+{
+	// Summation is commutative, so the result does not depend on the set's iteration order.
+	DocumentFingerprint result;
+
+	for(const auto word : words)
+	{
+		const DocumentFingerprint word_fingerprint = ComputeWordFingerprint(word);
+		result.high += word_fingerprint.high;
+		result.low += word_fingerprint.low;
+	}
+
+	result.high = Mix64(result.high + words.size());
+	result.low = Mix64(result.low ^ words.size());
+
+	return result;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <memory_resource>
+#include <unordered_set>
+
+// 128-bit order-independent fingerprint of a document's term set.
+// Equal term sets always produce equal fingerprints; unequal sets collide
+// with negligible probability, so callers still confirm a match by comparing the sets.
+struct DocumentFingerprint
+{
+	uint64_t high = 0;
+	uint64_t low = 0;
+
+	bool operator==(const DocumentFingerprint& other) const
+	{
+		return high == other.high && low == other.low;
+	}
+
+	bool operator!=(const DocumentFingerprint& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+struct DocumentFingerprintHasher
+{
+	size_t operator()(const DocumentFingerprint& fingerprint) const
+	{
+		return static_cast<size_t>(fingerprint.high ^ (fingerprint.low * 0x9E3779B97F4A7C15ull));
+	}
+};
+
+DocumentFingerprint ComputeWordFingerprint(std::string_view word);
+
+DocumentFingerprint ComputeDocumentFingerprint(const std::pmr::unordered_set<std::string_view>& words);
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include "impact_index.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+ImpactIndex::ImpactIndex(const std::pmr::map<std::string_view, std::pmr::map<int, double>>& word_to_document_freqs, const std::pmr::map<int, DocumentData>& documents,
+	ImpactLayout layout)
+	: layout_(layout)
+{
+	std::unordered_map<int, uint32_t> id_to_slot;
+	id_to_slot.reserve(documents.size());
+	documents_.reserve(documents.size());
+
+	for(const auto& [document_id, data] : documents)
+	{
+		id_to_slot.emplace(document_id, static_cast<uint32_t>(documents_.size()));
+		documents_.push_back({document_id, data.status, data.rating});
+	}
+
+	const double document_count = static_cast<double>(documents.size());
+	double max_impact = 0;
+
+	for(const auto& [word, postings] : word_to_document_freqs)
+	{
+		if(!postings.empty())
+		{
+			const double inverse_document_freq = std::log(document_count / postings.size());
+
+			for(const auto& [document_id, term_freq] : postings)
+			{
+				max_impact = std::max(max_impact, term_freq * inverse_document_freq);
+			}
+		}
+	}
+
+	constexpr double max_level = std::numeric_limits<uint16_t>::max();
+	scale_ = max_impact > 0 ? max_impact / max_level : 1.0;
+
+	terms_.reserve(word_to_document_freqs.size());
+
+	for(const auto& [word, postings] : word_to_document_freqs)
+	{
+		if(postings.empty())
+		{
+			continue;
+		}
+
+		const double inverse_document_freq = std::log(document_count / postings.size());
+		TermPostings& term = terms_[word];
+		term.slots.reserve(postings.size());
+		term.impacts.reserve(postings.size());
+
+		for(const auto& [document_id, term_freq] : postings)
+		{
+			term.slots.push_back(id_to_slot.at(document_id));
+			term.impacts.push_back(static_cast<uint16_t>(std::min(max_level, std::round(term_freq * inverse_document_freq / scale_))));
+		}
+
+		if(layout == ImpactLayout::IMPACT_ORDERED)
+		{
+			std::vector<uint32_t> order(term.slots.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [&term](uint32_t lhs, uint32_t rhs) { return term.impacts[lhs] > term.impacts[rhs]; });
+
+			TermPostings sorted;
+			sorted.slots.reserve(order.size());
+			sorted.impacts.reserve(order.size());
+
+			for(const uint32_t i : order)
+			{
+				sorted.slots.push_back(term.slots[i]);
+				sorted.impacts.push_back(term.impacts[i]);
+			}
+
+			term = std::move(sorted);
+		}
+	}
+}
+
+ImpactIndex::AccumulatorScratch& ImpactIndex::GetScratch() const
+{
+	thread_local AccumulatorScratch scratch;
+
+	if(scratch.scores.size() < documents_.size())
+	{
+		scratch.scores.resize(documents_.size());
+		scratch.marks.resize(documents_.size());
+	}
+
+	return scratch;
+}
+
+void ImpactIndex::ExcludeMinusWords(const std::deque<std::string_view>& minus_words, AccumulatorScratch& scratch, Accumulation& accumulation) const
+{
+	uint8_t* const marks = scratch.marks.data();
+
+	for(const auto word : minus_words)
+	{
+		const auto it = terms_.find(word);
+
+		if(it == terms_.end())
+		{
+			continue;
+		}
+
+		for(const uint32_t slot : it->second.slots)
+		{
+			if(marks[slot] == 0)
+			{
+				scratch.touched.push_back(slot);
+			}
+			marks[slot] = EXCLUDED;
+		}
+
+		accumulation.postings_read += it->second.slots.size();
+	}
+}
+
+void ImpactIndex::Accumulate(const std::deque<std::string_view>& plus_words, const std::deque<std::string_view>& minus_words, Accumulation& accumulation) const
+{
+	AccumulatorScratch& scratch = GetScratch();
+	uint32_t* const scores = scratch.scores.data();
+	uint8_t* const marks = scratch.marks.data();
+
+	accumulation.postings_read = 0;
+	ExcludeMinusWords(minus_words, scratch, accumulation);
+
+	for(const auto word : plus_words)
+	{
+		const auto it = terms_.find(word);
+
+		if(it == terms_.end())
+		{
+			continue;
+		}
+
+		const uint32_t* const slots = it->second.slots.data();
+		const uint16_t* const impacts = it->second.impacts.data();
+		const size_t size = it->second.slots.size();
+		accumulation.postings_read += size;
+
+		for(size_t i = 0; i < size; ++i)
+		{
+			const uint32_t slot = slots[i];
+
+			if(marks[slot] == 0)
+			{
+				marks[slot] = TOUCHED;
+				scratch.touched.push_back(slot);
+			}
+
+			scores[slot] += impacts[i];
+		}
+	}
+
+	accumulation.slots.clear();
+	accumulation.scores.clear();
+	accumulation.slots.reserve(scratch.touched.size());
+	accumulation.scores.reserve(scratch.touched.size());
+
+	for(const uint32_t slot : scratch.touched)
+	{
+		if(marks[slot] == TOUCHED)
+		{
+			accumulation.slots.push_back(slot);
+			accumulation.scores.push_back(scores[slot]);
+		}
+
+		scores[slot] = 0;
+		marks[slot] = 0;
+	}
+
+	scratch.touched.clear();
+}
+
+std::vector<uint32_t> ImpactIndex::Intersect(const std::deque<std::string_view>& words, size_t& postings_read) const
+{
+	std::vector<const std::vector<uint32_t>*> lists;
+	lists.reserve(words.size());
+
+	for(const auto word : words)
+	{
+		const auto it = terms_.find(word);
+
+		if(it == terms_.end())
+		{
+			return {};
+		}
+
+		lists.push_back(&it->second.slots);
+	}
+
+	if(lists.empty())
+	{
+		return {};
+	}
+
+	std::sort(lists.begin(), lists.end(), [](const auto* lhs, const auto* rhs) { return lhs->size() < rhs->size(); });
+
+	std::vector<uint32_t> slots(*lists.front());
+	postings_read += slots.size();
+
+	for(size_t i = 1; i < lists.size() && !slots.empty(); ++i)
+	{
+		IntersectWith(slots, *lists[i], postings_read);
+	}
+
+	return slots;
+}
+
+void ImpactIndex::IntersectWith(std::vector<uint32_t>& slots, const std::vector<uint32_t>& postings, size_t& postings_read)
+{
+	const uint32_t* const data = postings.data();
+	const size_t size = postings.size();
+	size_t position = 0;
+	size_t kept = 0;
+
+	for(const uint32_t slot : slots)
+	{
+		// position is the first posting that may still be >= slot.
+#if defined(__SSE2__)
+		// Slots are below 2^31, so a signed compare is exact.
+		if(position + 4 <= size)
+		{
+			const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+			const int below = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, _mm_set1_epi32(static_cast<int32_t>(slot)))));
+			postings_read += 4;
+
+			if(below != 0xF)
+			{
+				// Postings ascend, so the ones below slot are a prefix of the block.
+				position += __builtin_popcount(below);
+
+				if(data[position] == slot)
+				{
+					slots[kept++] = slot;
+					++position;
+				}
+
+				continue;
+			}
+
+			position += 4;
+		}
+#endif
+
+		// Gallop: double the step until a posting reaches slot, then binary search the last step.
+		size_t low = position;
+		size_t high = position;
+		size_t step = 1;
+
+		while(high < size && data[high] < slot)
+		{
+			low = high + 1;
+			high += step;
+			step <<= 1;
+			++postings_read;
+		}
+
+		position = std::lower_bound(data + low, data + std::min(high, size), slot) - data;
+
+		if(position == size)
+		{
+			break;
+		}
+
+		if(data[position] == slot)
+		{
+			slots[kept++] = slot;
+			++position;
+		}
+	}
+
+	slots.resize(kept);
+}
+
+ImpactLayout ImpactIndex::GetLayout() const
+{
+	return layout_;
+}
+
+const ImpactIndex::SlotDocument& ImpactIndex::GetDocument(uint32_t slot) const
+{
+	return documents_[slot];
+}
+
+double ImpactIndex::GetScale() const
+{
+	return scale_;
+}
+
+size_t ImpactIndex::GetPostingBytes() const
+{
+	size_t bytes = 0;
+
+	for(const auto& [word, term] : terms_)
+	{
+		bytes += term.slots.size() * sizeof(uint32_t) + term.impacts.size() * sizeof(uint16_t);
+	}
+
+	return bytes;
+}
+
+std::vector<uint32_t> ImpactIndex::SelectAtLeast(const std::vector<uint32_t>& scores, uint32_t cutoff)
+{
+	std::vector<uint32_t> positions;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// Scores stay far below 2^31 (65535 per query word), so a signed compare is exact.
+	if(cutoff > 0 && cutoff <= static_cast<uint32_t>(std::numeric_limits<int32_t>::max()))
+	{
+		const __m128i threshold = _mm_set1_epi32(static_cast<int32_t>(cutoff - 1));
+
+		for(; i + 4 <= scores.size(); i += 4)
+		{
+			const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scores.data() + i));
+			int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block, threshold)));
+
+			while(mask != 0)
+			{
+				const int lane = __builtin_ctz(mask);
+				positions.push_back(static_cast<uint32_t>(i + lane));
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+
+	for(; i < scores.size(); ++i)
+	{
+		if(scores[i] >= cutoff)
+		{
+			positions.push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	return positions;
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "document.h"
+
+// DOCUMENT_ORDERED keeps each term's postings in document order. IMPACT_ORDERED sorts them by
+// descending impact so AccumulateTop can read the best postings first and stop early; it
+// costs a sort per term at build time.
+enum class ImpactLayout
+{
+	DOCUMENT_ORDERED,
+	IMPACT_ORDERED,
+};
+
+// Read-only snapshot of the index with every posting's TF-IDF impact quantized to 16 bits.
+// Postings are two flat arrays (4-byte document slot, 2-byte impact) instead of map nodes
+// holding doubles, and a query accumulates them with integer adds only. Each quantized
+// impact is within half a step of the exact one, so a query of k words is within k steps
+// overall; callers use that bound to pick the few documents worth rescoring exactly.
+class ImpactIndex
+{
+public:
+	struct Accumulation
+	{
+		// Documents that match a plus word and no minus word, with their quantized scores.
+		std::vector<uint32_t> slots;
+		std::vector<uint32_t> scores;
+		// Posting entries read, minus words included.
+		size_t postings_read = 0;
+	};
+
+	struct SlotDocument
+	{
+		int id;
+		DocumentStatus status;
+		int rating;
+	};
+
+	ImpactIndex(const std::pmr::map<std::string_view, std::pmr::map<int, double>>& word_to_document_freqs, const std::pmr::map<int, DocumentData>& documents,
+		ImpactLayout layout = ImpactLayout::DOCUMENT_ORDERED);
+
+	void Accumulate(const std::deque<std::string_view>& plus_words, const std::deque<std::string_view>& minus_words, Accumulation& accumulation) const;
+
+	// IMPACT_ORDERED only. Reads plus-word postings score-at-a-time in bands of impact, the
+	// highest impacts of all words first, and stops once the unread ones can't lift any other document to within
+	// margin steps of the count-th best. The accumulation then holds only the documents that
+	// can still be among the count best within margin (partial scores), and never ones that
+	// fail predicate(const SlotDocument&), which is asked once per document read.
+	template<typename Predicate>
+	void AccumulateTop(const std::deque<std::string_view>& plus_words, const std::deque<std::string_view>& minus_words, size_t count, uint32_t margin,
+		Predicate predicate, Accumulation& accumulation) const;
+
+	// DOCUMENT_ORDERED only. Slots of the documents that contain every one of words, ascending.
+	// Starts from the shortest list and finds each remaining slot in the longer lists by
+	// galloping; four slots are compared at once before each gallop (SSE2 where available),
+	// so lists of similar length are merged almost linearly.
+	std::vector<uint32_t> Intersect(const std::deque<std::string_view>& words, size_t& postings_read) const;
+
+	ImpactLayout GetLayout() const;
+
+	const SlotDocument& GetDocument(uint32_t slot) const;
+
+	// Size of one quantization step in relevance units.
+	double GetScale() const;
+
+	size_t GetPostingBytes() const;
+
+	// Positions of the scores that are >= cutoff, in order (SSE2 where available).
+	static std::vector<uint32_t> SelectAtLeast(const std::vector<uint32_t>& scores, uint32_t cutoff);
+
+private:
+	struct TermPostings
+	{
+		std::vector<uint32_t> slots;
+		std::vector<uint16_t> impacts;
+	};
+
+	// Dense per-thread accumulator; every entry is back to zero between queries.
+	struct AccumulatorScratch
+	{
+		std::vector<uint32_t> scores;
+		std::vector<uint8_t> marks;
+		std::vector<uint32_t> touched;
+		std::vector<uint32_t> kth_scores;
+	};
+
+	inline static constexpr uint8_t TOUCHED = 1;
+	inline static constexpr uint8_t EXCLUDED = 2;
+	// The count-th best score is recomputed after this many postings at least, and never
+	// more often than once per live candidate, so the checks stay linear overall.
+	inline static constexpr size_t MIN_CHECK_INTERVAL = 1024;
+
+	std::unordered_map<std::string_view, TermPostings> terms_;
+	std::vector<SlotDocument> documents_;
+	double scale_ = 1.0;
+	ImpactLayout layout_ = ImpactLayout::DOCUMENT_ORDERED;
+
+	AccumulatorScratch& GetScratch() const;
+	// Keeps the slots (ascending) that postings also holds.
+	static void IntersectWith(std::vector<uint32_t>& slots, const std::vector<uint32_t>& postings, size_t& postings_read);
+	void ExcludeMinusWords(const std::deque<std::string_view>& minus_words, AccumulatorScratch& scratch, Accumulation& accumulation) const;
+};
+
+template<typename Predicate>
+void ImpactIndex::AccumulateTop(const std::deque<std::string_view>& plus_words, const std::deque<std::string_view>& minus_words, size_t count, uint32_t margin,
+	Predicate predicate, Accumulation& accumulation) const
+{
+	struct Cursor
+	{
+		const uint32_t* slots;
+		const uint16_t* impacts;
+		size_t position;
+		size_t size;
+	};
+
+	AccumulatorScratch& scratch = GetScratch();
+	uint32_t* const scores = scratch.scores.data();
+	uint8_t* const marks = scratch.marks.data();
+
+	accumulation.postings_read = 0;
+	ExcludeMinusWords(minus_words, scratch, accumulation);
+
+	std::vector<Cursor> cursors;
+	size_t unread = 0;
+	// Sum of the next unread impact of every word: the most any document can still gain.
+	uint64_t frontier = 0;
+
+	for(const auto word : plus_words)
+	{
+		const auto it = terms_.find(word);
+
+		if(it != terms_.end())
+		{
+			cursors.push_back({it->second.slots.data(), it->second.impacts.data(), 0, it->second.slots.size()});
+			unread += it->second.slots.size();
+			frontier += it->second.impacts.front();
+		}
+	}
+
+	size_t live_count = 0;
+	size_t since_check = 0;
+
+	// The count-th best of the scores so far; 0 while fewer documents are live.
+	const auto compute_kth_score = [&]() -> uint64_t
+	{
+		if(count == 0 || live_count < count)
+		{
+			return 0;
+		}
+
+		scratch.kth_scores.clear();
+
+		for(const uint32_t slot : scratch.touched)
+		{
+			if(marks[slot] == TOUCHED)
+			{
+				scratch.kth_scores.push_back(scores[slot]);
+			}
+		}
+
+		std::nth_element(scratch.kth_scores.begin(), scratch.kth_scores.begin() + (count - 1), scratch.kth_scores.end(), std::greater<>());
+		return scratch.kth_scores[count - 1];
+	};
+
+	uint64_t kth_score = 0;
+
+	while(unread > 0)
+	{
+		uint32_t level = 0;
+
+		for(const Cursor& cursor : cursors)
+		{
+			if(cursor.position < cursor.size)
+			{
+				level = std::max<uint32_t>(level, cursor.impacts[cursor.position]);
+			}
+		}
+
+		// One band: the postings of every word with impacts within a quarter of the highest
+		// unread one. Bands keep the per-posting overhead at an add while the bound still
+		// shrinks geometrically.
+		const uint32_t lower = level - level / 4;
+		size_t read = 0;
+		frontier = 0;
+
+		for(Cursor& cursor : cursors)
+		{
+			const size_t begin = cursor.position;
+
+			for(; cursor.position < cursor.size && cursor.impacts[cursor.position] >= lower; ++cursor.position)
+			{
+				const uint32_t slot = cursor.slots[cursor.position];
+
+				if(marks[slot] == 0)
+				{
+					scratch.touched.push_back(slot);
+
+					if(predicate(documents_[slot]))
+					{
+						marks[slot] = TOUCHED;
+						++live_count;
+					}
+					else
+					{
+						marks[slot] = EXCLUDED;
+					}
+				}
+
+				if(marks[slot] == TOUCHED)
+				{
+					scores[slot] += cursor.impacts[cursor.position];
+				}
+			}
+
+			read += cursor.position - begin;
+			frontier += cursor.position < cursor.size ? cursor.impacts[cursor.position] : 0;
+		}
+
+		unread -= read;
+		since_check += read;
+		accumulation.postings_read += read;
+
+		if(unread == 0)
+		{
+			kth_score = compute_kth_score();
+		}
+		else if(live_count >= count && since_check >= std::max(MIN_CHECK_INTERVAL, live_count))
+		{
+			since_check = 0;
+			kth_score = compute_kth_score();
+
+			// An unread document scores at most frontier, which is now too far behind.
+			if(frontier + margin < kth_score)
+			{
+				break;
+			}
+		}
+	}
+
+	accumulation.slots.clear();
+	accumulation.scores.clear();
+
+	for(const uint32_t slot : scratch.touched)
+	{
+		if(marks[slot] == TOUCHED && scores[slot] + frontier + margin >= kth_score)
+		{
+			accumulation.slots.push_back(slot);
+			accumulation.scores.push_back(scores[slot]);
+		}
+
+		scores[slot] = 0;
+		marks[slot] = 0;
+	}
+
+	scratch.touched.clear();
+}
@@ -2,12 +2,21 @@
 
 #include <chrono>
 #include <iostream>
+#include "metrics.h"
 
 #define PROFILE_CONCAT_INTERNAL(X, Y) X##Y
 #define PROFILE_CONCAT(X, Y) PROFILE_CONCAT_INTERNAL(X, Y)
 #define UNIQUE_VAR_NAME_PROFILE PROFILE_CONCAT(profileGuard, __LINE__)
+
+// With LOG_DURATION_TO_METRICS defined the durations go to MetricsRegistry histograms
+// named after the id instead of being printed to std::cerr.
+#ifdef LOG_DURATION_TO_METRICS
+#define LOG_DURATION(x) ScopedMetricTimer UNIQUE_VAR_NAME_PROFILE(x)
+#define LOG_DURATION_NS(x) ScopedMetricTimer UNIQUE_VAR_NAME_PROFILE(x)
+#else
 #define LOG_DURATION(x) LogDuration UNIQUE_VAR_NAME_PROFILE(x)
 #define LOG_DURATION_NS(x) LogDurationNS UNIQUE_VAR_NAME_PROFILE(x)
+#endif
 
 class LogDuration 
 {
@@ -13,15 +13,22 @@
 #include <iomanip>
 #include <sstream>
 #include <random>
+#include <thread>
+#include <atomic>
+#include <fstream>
 #include "search_server.h"
+#include "concurrent_index_builder.h"
 #include "paginator.h"
 #include "string_processing.h"
 #include "read_input_functions.h"
 #include "test_framework.h"
 #include "remove_duplicates.h"
 #include "request_queue.h"
+#include "slow_query_log.h"
 #include "process_queries.h"
+#include "query_service.h"
 #include "log_duration.h"
+#include "metrics.h"
 #include <execution>
 
 using namespace std;
@@ -316,6 +323,1289 @@ void TestDocumentsMatching()
     //std::cout << "Returned: " << result_vec << std::endl;
     // More code here
 }
+void TestDuplicatedIds()
+{
+	SearchServer server("and with"s);
+	server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+	server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+	server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+	server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+	server.AddDocument(5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+	server.AddDocument(6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+	server.AddDocument(7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, {1, 2});
+	server.AddDocument(8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, {1, 2});
+	server.AddDocument(9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+	{
+		const std::set<int> expected = {3, 4, 5, 7};
+		ASSERT(server.GetDuplicatedIds() == expected);
+	}
+	RemoveDuplicates(server);
+	ASSERT_EQUAL(server.GetDocumentCount(), 5);
+	ASSERT(server.GetDuplicatedIds().empty());
+}
+
+void TestNearDuplicateClusters()
+{
+	SearchServer server("and with"s);
+	server.AddDocument(1, "white cat yellow hat big fluffy tail green eyes long whiskers soft paws"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(2, "nasty dog big eyes"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(3, "white cat yellow hat big fluffy tail green eyes long whiskers soft"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(4, "curly pigeon john"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(5, "white cat yellow hat big fluffy tail green eyes long whiskers soft paws"s, DocumentStatus::ACTUAL, {1});
+	{
+		const auto clusters = server.GetNearDuplicateClusters();
+		ASSERT_EQUAL(clusters.size(), 1);
+		ASSERT(clusters[0] == vector<int>({1, 3, 5}));
+	}
+	{
+		NearDuplicateOptions exact_only;
+		exact_only.similarity_threshold = 1.0;
+		const auto clusters = server.GetNearDuplicateClusters(exact_only);
+		ASSERT_EQUAL(clusters.size(), 1);
+		ASSERT(clusters[0] == vector<int>({1, 5}));
+	}
+	{
+		// Thousands of copies share every bucket; they still form a single cluster.
+		SearchServer copies;
+		for (int id = 0; id < 5000; ++id)
+		{
+			copies.AddDocument(id, "white cat yellow hat big fluffy tail green eyes long whiskers soft paws short nose sharp claws striped back pink "s + (id % 2 == 0 ? "tongue"s : "ears"s), DocumentStatus::ACTUAL, {1});
+		}
+		const auto clusters = copies.GetNearDuplicateClusters();
+		ASSERT_EQUAL(clusters.size(), 1);
+		ASSERT_EQUAL(clusters[0].size(), 5000u);
+	}
+}
+
+void TestIncrementalDuplicateTracking()
+{
+	{
+		SearchServer server("and with"s);
+		server.SetDuplicateHandling(DuplicateHandling::TRACK);
+		server.AddDocument(5, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {1});
+		server.AddDocument(7, "nasty rat with funny pet"s, DocumentStatus::ACTUAL, {1});
+		server.AddDocument(8, "curly hair"s, DocumentStatus::ACTUAL, {1});
+		ASSERT(server.IsDuplicate(7));
+		server.AddDocument(3, "rat pet nasty funny"s, DocumentStatus::ACTUAL, {1});
+		ASSERT(server.GetDuplicatedIds() == std::set<int>({5, 7}));
+		server.RemoveDocument(3);
+		ASSERT(server.GetDuplicatedIds() == std::set<int>({7}));
+		server.RemoveDocument(5);
+		ASSERT(server.GetDuplicatedIds().empty());
+	}
+	{
+		SearchServer server("and with"s);
+		server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {1});
+		server.SetDuplicateHandling(DuplicateHandling::REJECT);
+		try
+		{
+			server.AddDocument(2, "funny funny pet nasty rat"s, DocumentStatus::ACTUAL, {1});
+			ASSERT_HINT(false, "Duplicate document must be rejected");
+		}
+		catch(const std::invalid_argument&)
+		{
+		}
+		ASSERT_EQUAL(server.GetDocumentCount(), 1);
+		ASSERT(server.FindTopDocuments("funny"s).size() == 1);
+	}
+}
+
+void TestProcessQueries()
+{
+	SearchServer server("and with"s);
+	int id = 0;
+	for (const string& text : {"funny pet and nasty rat"s, "funny pet with curly hair"s, "funny pet and not very nasty rat"s,
+							   "pet with rat and rat and rat"s, "nasty rat with curly hair"s})
+	{
+		server.AddDocument(++id, text, DocumentStatus::ACTUAL, {1, 2});
+	}
+	const vector<string> queries = {"nasty rat -not"s, "not very funny nasty pet"s, "curly hair"s};
+	{
+		SearchThreadPool pool(3);
+		const auto results = ProcessQueries(pool, server, queries);
+		ASSERT_EQUAL(results.size(), 3);
+		ASSERT_EQUAL(results[0].size(), 3);
+		ASSERT_EQUAL(results[1].size(), 5);
+		ASSERT_EQUAL(results[2].size(), 2);
+
+		std::mutex results_mutex;
+		vector<size_t> streamed(queries.size());
+		ProcessQueriesStream(pool, server, queries, [&](size_t index, vector<Document> documents)
+		{
+			const std::lock_guard<std::mutex> lock(results_mutex);
+			streamed[index] = documents.size();
+		});
+		ASSERT(streamed == vector<size_t>({3, 5, 2}));
+	}
+	{
+		const JoinedDocuments joined = ProcessQueriesJoined(server, queries);
+		ASSERT_EQUAL(joined.size(), 10);
+		ASSERT_EQUAL(joined.GetQueryCount(), 3);
+		size_t visited = 0;
+		for (const Document& document : joined)
+		{
+			ASSERT(document.id > 0);
+			++visited;
+		}
+		ASSERT_EQUAL(visited, 10);
+		const auto third = joined.GetQueryDocuments(2);
+		ASSERT_EQUAL(third.end() - third.begin(), 2);
+	}
+	{
+		// The limit in use applies, above the default as well as below it.
+		SearchThreadPool pool(2);
+		for (const size_t limit : {size_t(2), size_t(8), numeric_limits<size_t>::max()})
+		{
+			SearchOptions options;
+			options.limit = limit;
+			const JoinedDocuments joined = ProcessQueriesJoined(pool, server, queries, options);
+			for (size_t i = 0; i < queries.size(); ++i)
+			{
+				const auto expected = server.FindTopDocuments(std::execution::seq, queries[i], DocumentStatus::ACTUAL);
+				const auto range = joined.GetQueryDocuments(i);
+				ASSERT_EQUAL(static_cast<size_t>(range.end() - range.begin()), min(limit, expected.size()));
+				ASSERT_EQUAL(range.begin()->id, expected.front().id);
+			}
+		}
+
+		// Many queries split over several tasks still come back in query order.
+		vector<string> many_queries;
+		for (int i = 0; i < 50; ++i)
+		{
+			many_queries.push_back(queries[i % queries.size()]);
+		}
+		const JoinedDocuments joined = ProcessQueriesJoined(pool, server, many_queries, SearchOptions{});
+		ASSERT_EQUAL(joined.GetQueryCount(), many_queries.size());
+		for (size_t i = 0; i < many_queries.size(); ++i)
+		{
+			const auto expected = server.FindTopDocuments(many_queries[i]);
+			const auto range = joined.GetQueryDocuments(i);
+			ASSERT(equal(range.begin(), range.end(), expected.begin(), expected.end(), [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id; }));
+		}
+	}
+}
+
+void TestQueryService()
+{
+	SearchServer server("and with"s);
+	server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(2, "curly cat curly tail"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(3, "nasty dog with big eyes"s, DocumentStatus::BANNED, {1});
+	{
+		QueryService service(server, 4);
+		auto cats = service.SubmitQuery("curly cat"s);
+		auto banned = service.SubmitQuery("dog"s, DocumentStatus::BANNED);
+		ASSERT_EQUAL(cats.get().size(), 2);
+		ASSERT_EQUAL(banned.get().size(), 1);
+	}
+	for (const OverflowPolicy policy : {OverflowPolicy::REJECT, OverflowPolicy::SHED_OLDEST})
+	{
+		QueryService service(server, 1, policy, 1);
+		std::promise<void> started;
+		std::promise<void> gate;
+		std::shared_future<void> opened = gate.get_future().share();
+		bool first_call = true;
+		auto blocked = service.SubmitQuery("cat"s, [&](int, DocumentStatus, int)
+		{
+			if (first_call)
+			{
+				first_call = false;
+				started.set_value();
+				opened.wait();
+			}
+			return true;
+		});
+		started.get_future().wait();
+		auto queued = service.SubmitQuery("dog"s);
+		auto overflow = service.SubmitQuery("tail"s);
+		gate.set_value();
+		ASSERT_EQUAL(blocked.get().size(), 2);
+		auto& lost = policy == OverflowPolicy::REJECT ? overflow : queued;
+		auto& kept = policy == OverflowPolicy::REJECT ? queued : overflow;
+		try
+		{
+			lost.get();
+			ASSERT_HINT(false, "Overflowing query must fail");
+		}
+		catch (const QueueOverflowError&)
+		{
+		}
+		ASSERT_EQUAL(kept.get().size(), policy == OverflowPolicy::REJECT ? 0 : 1);
+		ASSERT_EQUAL(service.GetRejectedCount() + service.GetShedCount(), 1);
+	}
+}
+
+void TestRequestQueue()
+{
+	SearchServer server("and in at"s);
+	server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+	server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+	{
+		RequestQueue request_queue(server);
+		for (int i = 0; i < 10; ++i)
+		{
+			request_queue.AddFindRequest("empty request"s);
+		}
+		request_queue.AddFindRequest("curly dog"s);
+		request_queue.AddFindRequest("big collar"s);
+		ASSERT_EQUAL(request_queue.GetNoResultRequests(), 10);
+		ASSERT_EQUAL(request_queue.GetStatistics().total_requests, 12);
+	}
+	{
+		using namespace std::chrono_literals;
+		RequestQueue request_queue(server, 64s);
+		const auto start = RequestQueue::Clock::now();
+		request_queue.RecordRequest(0, 3ms, start);
+		request_queue.RecordRequest(2, 5ms, start + 10s);
+		{
+			const auto statistics = request_queue.GetStatistics(start + 20s);
+			ASSERT_EQUAL(statistics.total_requests, 2);
+			ASSERT_EQUAL(statistics.no_result_requests, 1);
+			ASSERT(statistics.max_latency == 5ms);
+			ASSERT(statistics.GetMeanLatency() == 4ms);
+		}
+		ASSERT_EQUAL(request_queue.GetStatistics(start + 70s).total_requests, 1);
+		ASSERT_EQUAL(request_queue.GetStatistics(start + 200s).total_requests, 0);
+	}
+	{
+		// A late write for an epoch that shares a bucket with a newer one must not wipe it.
+		using namespace std::chrono_literals;
+		RequestQueue request_queue(server, 64s);
+		const auto start = RequestQueue::Clock::now();
+		request_queue.RecordRequest(1, 2ms, start + 70s);
+		request_queue.RecordRequest(1, 9ms, start + 6s);
+		request_queue.RecordRequest(0, 4ms, start + 70s);
+		const auto statistics = request_queue.GetStatistics(start + 71s);
+		ASSERT_EQUAL(statistics.total_requests, 2);
+		ASSERT_EQUAL(statistics.no_result_requests, 1);
+		ASSERT(statistics.max_latency == 4ms);
+	}
+}
+
+void TestSlowQueryLog()
+{
+	using namespace std::chrono_literals;
+
+	SearchServer server("and in at"s);
+	server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+	server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::BANNED, {1, 2, 3});
+
+	{
+		// A zero threshold logs every request.
+		SlowQueryLog log(0ns, 0, 4);
+		RequestQueue request_queue(server);
+		request_queue.SetSlowQueryLog(&log);
+
+		ASSERT_EQUAL(request_queue.AddFindRequest("curly -collar"s).size(), 1u);
+		ASSERT_EQUAL(request_queue.AddFindRequest("curly"s, DocumentStatus::BANNED).size(), 1u);
+		request_queue.AddFindRequest("tail"s, [](int, DocumentStatus, int rating) { return rating > 100; });
+
+		const auto records = log.Snapshot();
+		ASSERT_EQUAL(records.size(), 3u);
+		ASSERT_EQUAL(records[0].GetQuery(), "curly -collar"sv);
+		ASSERT_EQUAL(records[0].GetFilter(), "status=ACTUAL"sv);
+		ASSERT_EQUAL(records[0].result_count, 1u);
+		// Two postings of "curly" and one of "collar".
+		ASSERT_EQUAL(records[0].postings_touched, 3u);
+		ASSERT(!records[0].is_sampled);
+		ASSERT(records[0].latency >= records[0].stage_durations[1]);
+		ASSERT_EQUAL(records[1].GetFilter(), "status=BANNED"sv);
+		ASSERT_EQUAL(records[2].GetFilter(), "predicate"sv);
+		ASSERT_EQUAL(records[2].result_count, 0u);
+
+		// The ring keeps the newest capacity records.
+		for (int i = 0; i < 3; ++i)
+		{
+			request_queue.AddFindRequest("cat"s);
+		}
+
+		const auto newest = log.Snapshot();
+		ASSERT_EQUAL(newest.size(), 4u);
+		ASSERT_EQUAL(newest.front().GetQuery(), "tail"sv);
+		ASSERT_EQUAL(newest.back().sequence, 5u);
+
+		const string path = "slow_query_log_test.jsonl"s;
+		log.DumpToFile(path);
+		ifstream dump(path);
+		string line;
+		size_t line_count = 0;
+
+		while (getline(dump, line))
+		{
+			++line_count;
+			ASSERT(line.find("\"stages_ns\":{\"parse\":"s) != string::npos);
+		}
+
+		ASSERT_EQUAL(line_count, 4u);
+		dump.close();
+		remove(path.c_str());
+	}
+	{
+		SlowQueryLog log(1h, 0);
+		ASSERT(!log.ShouldRecord(1s));
+		ASSERT(log.ShouldRecord(2h));
+
+		SlowQueryLog sampling_log(1h, 1);
+		ASSERT(sampling_log.ShouldRecord(1ns));
+
+		const string long_query(SlowQueryRecord::MAX_QUERY_LENGTH + 10, 'a');
+		sampling_log.Record(long_query, "\"quoted\""s, 0, 1ms, SlowQueryLog::Trace{});
+		const auto records = sampling_log.Snapshot();
+		ASSERT_EQUAL(records.size(), 1u);
+		ASSERT(records[0].is_sampled);
+		ASSERT(records[0].is_query_truncated);
+		ASSERT_EQUAL(records[0].GetQuery().size(), SlowQueryRecord::MAX_QUERY_LENGTH);
+	}
+	{
+		SlowQueryLog log(0ns, 0, 1024);
+		vector<thread> threads;
+
+		for (int t = 0; t < 4; ++t)
+		{
+			threads.emplace_back([&log]
+			{
+				for (int i = 0; i < 100; ++i)
+				{
+					log.Record("query"s, "filter"s, 1, 1ms, SlowQueryLog::Trace{});
+				}
+			});
+		}
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		ASSERT_EQUAL(log.GetRecordedCount() + log.GetDroppedCount(), 400u);
+		ASSERT_EQUAL(log.Snapshot().size(), log.GetRecordedCount());
+	}
+	{
+		// Snapshots taken while the ring is overwritten return only whole records.
+		SlowQueryLog log(0ns, 0, 8);
+		atomic<bool> done = false;
+		thread writer([&]
+		{
+			for (uint32_t i = 0; i < 20000; ++i)
+			{
+				log.Record(string(i % 200, 'q'), "filter"s, i % 200, 1ms, SlowQueryLog::Trace{});
+			}
+			done = true;
+		});
+
+		while (!done)
+		{
+			for (const auto& record : log.Snapshot())
+			{
+				ASSERT_EQUAL(record.GetQuery().size(), record.result_count);
+				ASSERT_EQUAL(record.result_count, record.sequence % 200);
+			}
+		}
+		writer.join();
+		ASSERT_EQUAL(log.Snapshot().size(), 8u);
+	}
+}
+
+void TestMetrics()
+{
+	LatencyHistogram histogram;
+	for (uint64_t value = 1; value <= 1000; ++value)
+	{
+		histogram.Record(value * 1000);
+	}
+	ASSERT_EQUAL(histogram.GetCount(), 1000);
+	ASSERT(std::abs(static_cast<double>(histogram.GetPercentile(50)) - 500000.0) <= 500000.0 / LatencyHistogram::SUB_BUCKET_COUNT);
+	ASSERT_EQUAL(histogram.GetMax(), 1000000);
+
+	const auto before = MetricsRegistry::Instance().Snapshot();
+	const auto count_of = [](const MetricsSnapshot& snapshot, const string& name) -> uint64_t
+	{
+		const auto it = snapshot.histograms.find(name);
+		return it == snapshot.histograms.end() ? 0 : it->second.GetCount();
+	};
+
+	SearchServer server("and with"s);
+	server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {1});
+	server.FindTopDocuments("curly -dog"s);
+	std::thread([]
+	{
+		MetricsRegistry::Instance().Record("test.worker"s, 42);
+	}).join();
+
+	const auto after = MetricsRegistry::Instance().Snapshot();
+	for (const auto& name : {"query.parse"s, "query.postings"s, "query.minus"s, "query.sort"s, "ingest.tokenize"s, "ingest.intern"s, "ingest.index"s})
+	{
+		ASSERT_EQUAL_HINT(count_of(after, name), count_of(before, name) + 1, name);
+	}
+	ASSERT_EQUAL(count_of(after, "test.worker"s), count_of(before, "test.worker"s) + 1);
+	ASSERT(after.ToJson().find("\"query.parse\":{\"count\":") != string::npos);
+	ASSERT(after.ToText().find("query.sort count=") != string::npos);
+}
+
+void TestSearchPagination()
+{
+	SearchServer server("and with"s);
+	for (int id = 1; id <= 12; ++id)
+	{
+		server.AddDocument(id, "cat "s + (id % 3 == 0 ? "dog"s : "bird"s), DocumentStatus::ACTUAL, {id % 4});
+	}
+
+	const auto actual = [](int document_id, DocumentStatus status, int rating) { return status == DocumentStatus::ACTUAL; };
+
+	SearchOptions everything;
+	everything.limit = 100;
+	const auto all = server.FindTopDocuments(std::execution::seq, "cat dog"s, actual, everything);
+	ASSERT_EQUAL(all.size(), 12u);
+	ASSERT(std::is_sorted(all.begin(), all.end(), SearchServer::IsRankedBefore));
+	ASSERT(std::adjacent_find(all.begin(), all.end(), [](const Document& lhs, const Document& rhs) { return !SearchServer::IsRankedBefore(lhs, rhs); }) == all.end());
+
+	// Each neighbour is within EPSILON of the next, but the ends are not: the order must
+	// still be transitive.
+	const vector<Document> near_ties = {{1, 0.0, 3}, {2, 0.6 * SearchServer::EPSILON, 2}, {3, 1.2 * SearchServer::EPSILON, 1}, {4, 1.8 * SearchServer::EPSILON, 0}};
+	for (const auto& a : near_ties)
+	{
+		ASSERT(!SearchServer::IsRankedBefore(a, a));
+		for (const auto& b : near_ties)
+		{
+			for (const auto& c : near_ties)
+			{
+				ASSERT(!(SearchServer::IsRankedBefore(a, b) && SearchServer::IsRankedBefore(b, c)) || SearchServer::IsRankedBefore(a, c));
+			}
+		}
+	}
+
+	SearchOptions page;
+	page.offset = 4;
+	page.limit = 3;
+	const auto by_offset = server.FindTopDocuments(std::execution::par, "cat dog"s, actual, page);
+	ASSERT_EQUAL(by_offset.size(), 3u);
+	for (size_t i = 0; i < by_offset.size(); ++i)
+	{
+		ASSERT_EQUAL(by_offset[i].id, all[4 + i].id);
+	}
+
+	SearchOptions after;
+	after.search_after = SearchCursor::After(all[6]);
+	const auto by_cursor = server.FindTopDocuments(std::execution::seq, "cat dog"s, actual, after);
+	ASSERT_EQUAL(by_cursor.size(), SearchServer::MAX_RESULT_DOCUMENT_COUNT);
+	ASSERT_EQUAL(by_cursor.front().id, all[7].id);
+
+	page.offset = 20;
+	ASSERT(server.FindTopDocuments(std::execution::seq, "cat dog"s, actual, page).empty());
+
+	vector<int> paged_ids;
+	size_t page_count = 0;
+	for (const auto& documents : server.PaginateTopDocuments("cat dog"s, 5))
+	{
+		++page_count;
+		for (const Document& document : documents)
+		{
+			paged_ids.push_back(document.id);
+		}
+	}
+	ASSERT_EQUAL(page_count, 3u);
+	ASSERT_EQUAL(paged_ids.size(), all.size());
+	for (size_t i = 0; i < all.size(); ++i)
+	{
+		ASSERT_EQUAL(paged_ids[i], all[i].id);
+	}
+}
+
+void TestPhraseQueries()
+{
+	SearchServer server("and with"s);
+	server.AddDocument(1, "funny pet with curly tail"s, DocumentStatus::ACTUAL, {1}, true);
+	server.AddDocument(2, "pet funny dog"s, DocumentStatus::ACTUAL, {2}, true);
+	server.AddDocument(3, "funny and pet"s, DocumentStatus::ACTUAL, {3}, true);
+	server.AddDocument(4, "funny pet"s, DocumentStatus::ACTUAL, {4});
+
+	const auto ids_of = [](const vector<Document>& documents)
+	{
+		vector<int> ids;
+		for (const Document& document : documents)
+		{
+			ids.push_back(document.id);
+		}
+		sort(ids.begin(), ids.end());
+		return ids;
+	};
+
+	ASSERT(ids_of(server.FindTopDocuments("\"funny pet\""s)) == vector<int>({1}));
+	ASSERT(ids_of(server.FindTopDocuments(std::execution::par, "\"funny pet\""s)) == vector<int>({1}));
+	ASSERT(ids_of(server.FindTopDocuments("\"funny with pet\""s)) == vector<int>({3}));
+	ASSERT(ids_of(server.FindTopDocuments("\"pet funny\" dog"s)) == vector<int>({2}));
+	ASSERT(ids_of(server.FindTopDocuments("\"funny pet\" -curly"s)).empty());
+	ASSERT(ids_of(server.FindTopDocuments("\"pet\""s)) == vector<int>({1, 2, 3, 4}));
+
+	const auto [matched_words, status] = server.MatchDocument("\"curly tail\""s, 1);
+	ASSERT_EQUAL(matched_words.size(), 2u);
+	ASSERT(get<0>(server.MatchDocument("\"tail curly\""s, 1)).empty());
+
+	try
+	{
+		server.FindTopDocuments("\"funny pet"s);
+		ASSERT_HINT(false, "unterminated phrase must throw"s);
+	}
+	catch (const invalid_argument&)
+	{
+	}
+
+	server.RemoveDocument(1);
+	ASSERT(server.FindTopDocuments("\"funny pet\""s).empty());
+}
+
+void TestPrefixQueries()
+{
+	SearchServer server("and with"s);
+	server.AddDocument(1, "cat with collar"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(2, "catalog of pets"s, DocumentStatus::ACTUAL, {2});
+	server.AddDocument(3, "cats and dog"s, DocumentStatus::ACTUAL, {3});
+	server.AddDocument(4, "dog"s, DocumentStatus::ACTUAL, {4});
+
+	const auto ids_of = [](const vector<Document>& documents)
+	{
+		vector<int> ids;
+		for (const Document& document : documents)
+		{
+			ids.push_back(document.id);
+		}
+		sort(ids.begin(), ids.end());
+		return ids;
+	};
+
+	ASSERT(ids_of(server.FindTopDocuments("cat*"s)) == vector<int>({1, 2, 3}));
+	ASSERT(ids_of(server.FindTopDocuments("dog -cat*"s)) == vector<int>({4}));
+	ASSERT(ids_of(server.FindTopDocuments("cow*"s)).empty());
+	ASSERT_EQUAL(get<0>(server.MatchDocument("cat* collar"s, 1)).size(), 2u);
+
+	server.RemoveDocument(2);
+	ASSERT(ids_of(server.FindTopDocuments("catalog*"s)).empty());
+
+	SearchServer wide;
+	for (int id = 0; id < 100; ++id)
+	{
+		wide.AddDocument(id, "term"s + to_string(id), DocumentStatus::ACTUAL, {0});
+	}
+
+	const auto expansions_of = [](const MetricsSnapshot& snapshot)
+	{
+		const auto it = snapshot.histograms.find("query.expand.terms"s);
+		return it == snapshot.histograms.end() ? LatencyHistogram{} : it->second;
+	};
+
+	const auto before = expansions_of(MetricsRegistry::Instance().Snapshot());
+	SearchOptions options;
+	options.limit = 1000;
+	const auto found = wide.FindTopDocuments(std::execution::seq, "term*"s, [](int, DocumentStatus, int) { return true; }, options);
+	ASSERT_EQUAL(found.size(), SearchServer::MAX_PREFIX_EXPANSION);
+
+	const auto after = expansions_of(MetricsRegistry::Instance().Snapshot());
+	ASSERT_EQUAL(after.GetCount(), before.GetCount() + 1);
+	ASSERT_EQUAL(after.GetMax(), SearchServer::MAX_PREFIX_EXPANSION);
+
+	// The cap only limits scoring: a minus prefix excludes, and an ALL prefix admits, every expansion.
+	SearchServer shared;
+	for (int id = 0; id < 100; ++id)
+	{
+		shared.AddDocument(id, "shared term"s + to_string(id), DocumentStatus::ACTUAL, {0});
+	}
+	shared.AddDocument(100, "shared other"s, DocumentStatus::ACTUAL, {0});
+
+	const auto excluded = shared.FindTopDocuments(std::execution::seq, "shared -term*"s, [](int, DocumentStatus, int) { return true; }, options);
+	ASSERT(ids_of(excluded) == vector<int>({100}));
+
+	SearchOptions all_options = options;
+	all_options.match_mode = MatchMode::ALL;
+	const auto required = shared.FindTopDocuments(std::execution::seq, "shared term*"s, [](int, DocumentStatus, int) { return true; }, all_options);
+	ASSERT_EQUAL(required.size(), 100u);
+}
+
+void TestFuzzyQueries()
+{
+	const auto levenshtein = [](const string& lhs, const string& rhs)
+	{
+		vector<int> row(rhs.size() + 1);
+		iota(row.begin(), row.end(), 0);
+		for (size_t i = 1; i <= lhs.size(); ++i)
+		{
+			int diagonal = row[0];
+			row[0] = static_cast<int>(i);
+			for (size_t j = 1; j <= rhs.size(); ++j)
+			{
+				const int above = row[j];
+				row[j] = min({row[j] + 1, row[j - 1] + 1, diagonal + (lhs[i - 1] == rhs[j - 1] ? 0 : 1)});
+				diagonal = above;
+			}
+		}
+		return row.back();
+	};
+
+	mt19937 generator(42);
+	TermDictionary dictionary;
+	vector<string> terms;
+	for (int i = 0; i < 2000; ++i)
+	{
+		string term(uniform_int_distribution<int>(1, 6)(generator), 'a');
+		for (char& c : term)
+		{
+			c = static_cast<char>('a' + uniform_int_distribution<int>(0, 3)(generator));
+		}
+		dictionary.Intern(term);
+		terms.push_back(term);
+	}
+	sort(terms.begin(), terms.end());
+	terms.erase(unique(terms.begin(), terms.end()), terms.end());
+
+	for (const auto& word : {"abc"s, "dddd"s, "a"s, "bacdab"s})
+	{
+		for (int distance = 0; distance <= 2; ++distance)
+		{
+			map<string, int> expected;
+			for (const string& term : terms)
+			{
+				if (levenshtein(word, term) <= distance)
+				{
+					expected[term] = levenshtein(word, term);
+				}
+			}
+
+			map<string, int> found;
+			dictionary.ForEachWithinDistance(word, distance, [&found](string_view term, int term_distance) { found[string(term)] = term_distance; });
+			ASSERT_HINT(found == expected, word);
+		}
+	}
+
+	SearchServer server("and with"s);
+	server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(2, "white car"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(3, "black dog"s, DocumentStatus::ACTUAL, {1});
+
+	ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 1u);
+
+	const auto fuzzy = server.FindTopDocuments("cat~"s);
+	ASSERT_EQUAL(fuzzy.size(), 2u);
+	ASSERT_EQUAL(fuzzy[0].id, 1);
+	ASSERT(abs(fuzzy[1].relevance - fuzzy[0].relevance * 0.5) < SearchServer::EPSILON);
+
+	ASSERT(server.FindTopDocuments("cta~1"s).empty());
+	ASSERT_EQUAL(server.FindTopDocuments("cta~2"s).size(), 2u);
+	ASSERT_EQUAL(server.FindTopDocuments(std::execution::par, "cta~2"s).size(), 2u);
+
+	server.SetFuzzyPenalty(0.0);
+	const auto unpenalized = server.FindTopDocuments("cat~1"s);
+	ASSERT(abs(unpenalized[0].relevance - unpenalized[1].relevance) < SearchServer::EPSILON);
+
+	try
+	{
+		server.FindTopDocuments("dgo~3"s);
+		ASSERT_HINT(false, "fuzzy distance above the maximum must throw"s);
+	}
+	catch (const invalid_argument&)
+	{
+	}
+}
+
+struct MatchedTermCountRanking
+{
+	struct TermScorer
+	{
+		double operator()(double, const DocumentData&) const
+		{
+			return 1.0;
+		}
+	};
+
+	TermScorer PrepareTerm(const CorpusStatistics&, size_t) const
+	{
+		return {};
+	}
+};
+
+void TestRankingPolicies()
+{
+	SearchServer server("and with"s);
+	server.AddDocument(1, "cat cat dog"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(2, "cat and bird bird bird bird"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(3, "bird"s, DocumentStatus::ACTUAL, {1});
+
+	const CorpusStatistics corpus = server.GetCorpusStatistics();
+	ASSERT_EQUAL(corpus.document_count, 3u);
+	ASSERT(abs(corpus.average_document_length - 3.0) < SearchServer::EPSILON);
+
+	const auto actual = [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; };
+
+	const auto tf_idf = server.FindTopDocuments(std::execution::seq, "cat"s, actual, SearchOptions{}, TfIdfRanking{});
+	const auto by_default = server.FindTopDocuments("cat"s);
+	ASSERT_EQUAL(tf_idf.size(), by_default.size());
+	ASSERT(abs(tf_idf[0].relevance - by_default[0].relevance) < SearchServer::EPSILON);
+
+	const double inverse_document_freq = log(1 + (3 - 2 + 0.5) / (2 + 0.5));
+	for (const auto& policy_result : {server.FindTopDocuments(std::execution::seq, "cat"s, actual, SearchOptions{}, Bm25Ranking{1.2, 0.75}),
+									 server.FindTopDocuments(std::execution::par, "cat"s, actual, SearchOptions{}, Bm25Ranking{1.2, 0.75})})
+	{
+		ASSERT_EQUAL(policy_result.size(), 2u);
+		ASSERT_EQUAL(policy_result[0].id, 1);
+		ASSERT(abs(policy_result[0].relevance - inverse_document_freq * 2 * 2.2 / (2 + 1.2)) < SearchServer::EPSILON);
+		ASSERT(abs(policy_result[1].relevance - inverse_document_freq * 1 * 2.2 / (1 + 1.2 * (0.25 + 0.75 * 5 / 3))) < SearchServer::EPSILON);
+	}
+
+	const auto counted = server.FindTopDocuments(std::execution::seq, "cat dog bird"s, actual, SearchOptions{}, MatchedTermCountRanking{});
+	ASSERT_EQUAL(counted[0].id, 1);
+	ASSERT(abs(counted[0].relevance - 2.0) < SearchServer::EPSILON);
+	ASSERT(abs(counted[2].relevance - 1.0) < SearchServer::EPSILON);
+
+	server.RemoveDocument(2);
+	ASSERT(abs(server.GetCorpusStatistics().average_document_length - 2.0) < SearchServer::EPSILON);
+}
+
+void TestImpactIndex()
+{
+	mt19937 generator(7);
+	vector<string> dictionary;
+	for (int i = 0; i < 300; ++i)
+	{
+		dictionary.push_back("w"s + to_string(i));
+	}
+
+	// Zipf-like word choice gives postings of very different lengths and many near-ties.
+	const auto random_word = [&]
+	{
+		const double u = uniform_real_distribution<double>(0, 1)(generator);
+		return dictionary[static_cast<size_t>(pow(u, 3) * dictionary.size())];
+	};
+
+	SearchServer server;
+	size_t posting_count = 0;
+	for (int id = 0; id < 2000; ++id)
+	{
+		string text;
+		set<string> words;
+		const int length = uniform_int_distribution<int>(3, 30)(generator);
+		for (int i = 0; i < length; ++i)
+		{
+			const string word = random_word();
+			words.insert(word);
+			text += word + " "s;
+		}
+		posting_count += words.size();
+		server.AddDocument(id, text, static_cast<DocumentStatus>(id % 3), {id % 11 - 5});
+	}
+
+	vector<string> queries;
+	for (int i = 0; i < 200; ++i)
+	{
+		string query;
+		for (int j = 0; j < 1 + i % 6; ++j)
+		{
+			query += (j > 0 && i % 5 == 0 ? "-"s : ""s) + random_word() + " "s;
+		}
+		queries.push_back(query);
+	}
+
+	const auto rated = [](int, DocumentStatus status, int rating) { return status != DocumentStatus::BANNED && rating >= -3; };
+	SearchOptions page;
+	page.offset = 3;
+	page.limit = 10;
+
+	const auto run = [&]
+	{
+		vector<vector<Document>> results;
+		for (const string& query : queries)
+		{
+			results.push_back(server.FindTopDocuments(query));
+			results.push_back(server.FindTopDocuments(std::execution::par, query, rated, page));
+		}
+		return results;
+	};
+
+	const auto expected = run();
+	server.BuildImpactIndex();
+	ASSERT(server.HasImpactIndex());
+	ASSERT(server.GetImpactIndex()->GetPostingBytes() * 2 <= posting_count * (sizeof(int) + sizeof(double)));
+
+	const auto rescored = [] {
+		const auto snapshot = MetricsRegistry::Instance().Snapshot();
+		const auto it = snapshot.histograms.find("query.impact.rescore"s);
+		return it == snapshot.histograms.end() ? uint64_t{0} : it->second.GetCount();
+	};
+	const uint64_t rescored_before = rescored();
+	const auto found = run();
+	ASSERT_EQUAL(rescored() - rescored_before, found.size());
+	ASSERT_EQUAL(found.size(), expected.size());
+	for (size_t i = 0; i < found.size(); ++i)
+	{
+		ASSERT_EQUAL_HINT(found[i].size(), expected[i].size(), queries[i / 2]);
+		for (size_t j = 0; j < found[i].size(); ++j)
+		{
+			ASSERT_EQUAL_HINT(found[i][j].id, expected[i][j].id, queries[i / 2]);
+			ASSERT_EQUAL(found[i][j].relevance, expected[i][j].relevance);
+		}
+	}
+
+	// Early termination reads only part of the postings and still gives the same results.
+	const auto [document_ordered, document_ordered_explanation] = server.ExplainTopDocuments("w0 w1 w2"s);
+	server.BuildImpactIndex(ImpactLayout::IMPACT_ORDERED);
+	ASSERT(server.GetImpactIndex()->GetLayout() == ImpactLayout::IMPACT_ORDERED);
+	const auto [impact_ordered, impact_ordered_explanation] = server.ExplainTopDocuments("w0 w1 w2"s);
+	ASSERT(impact_ordered_explanation.used_impact_index);
+	ASSERT(impact_ordered_explanation.postings_touched < document_ordered_explanation.postings_touched);
+	ASSERT_EQUAL(impact_ordered.size(), document_ordered.size());
+
+	const auto found_impact_ordered = run();
+	ASSERT_EQUAL(found_impact_ordered.size(), expected.size());
+	for (size_t i = 0; i < found_impact_ordered.size(); ++i)
+	{
+		ASSERT_EQUAL_HINT(found_impact_ordered[i].size(), expected[i].size(), queries[i / 2]);
+		for (size_t j = 0; j < found_impact_ordered[i].size(); ++j)
+		{
+			ASSERT_EQUAL_HINT(found_impact_ordered[i][j].id, expected[i][j].id, queries[i / 2]);
+			ASSERT_EQUAL(found_impact_ordered[i][j].relevance, expected[i][j].relevance);
+		}
+	}
+
+	const auto invalidations = []
+	{
+		const auto snapshot = MetricsRegistry::Instance().Snapshot();
+		const auto it = snapshot.histograms.find("index.impact.invalidated"s);
+		return it == snapshot.histograms.end() ? uint64_t{0} : it->second.GetCount();
+	};
+
+	// Writes drop the snapshot once, visibly; later writes have nothing left to drop.
+	const uint64_t invalidations_before = invalidations();
+	server.AddDocument(5000, "w1 w2"s, DocumentStatus::ACTUAL, {1});
+	ASSERT(!server.HasImpactIndex());
+	ASSERT_EQUAL(invalidations(), invalidations_before + 1);
+	server.RemoveDocument(5000);
+	ASSERT_EQUAL(invalidations(), invalidations_before + 1);
+}
+
+void TestMemoryUsage()
+{
+	SearchServer server("and with"s);
+	const MemoryUsageReport empty = server.MemoryUsage();
+	ASSERT(empty.stop_words > 0);
+	ASSERT_EQUAL(empty.postings, 0u);
+	ASSERT_EQUAL(empty.documents, 0u);
+	ASSERT_EQUAL(empty.document_ids, 0u);
+	ASSERT_EQUAL(empty.term_dictionary, 0u);
+
+	server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(2, "a cat with a remarkably long descriptive name"s, DocumentStatus::ACTUAL, {1});
+	const MemoryUsageReport filled = server.MemoryUsage();
+	ASSERT(filled.postings > 0);
+	ASSERT(filled.documents > 0);
+	ASSERT(filled.document_ids > 0);
+	ASSERT(filled.term_dictionary > 0);
+	ASSERT_EQUAL(filled.GetTotal(), filled.term_dictionary + filled.postings + filled.documents + filled.document_ids + filled.stop_words);
+
+	const LatencyHistogram posting_lengths = server.GetPostingLengthHistogram();
+	ASSERT_EQUAL(posting_lengths.GetCount(), 8u);
+	ASSERT_EQUAL(posting_lengths.GetMax(), 2u);
+
+	const LatencyHistogram document_lengths = server.GetDocumentLengthHistogram();
+	ASSERT_EQUAL(document_lengths.GetCount(), 2u);
+	ASSERT_EQUAL(document_lengths.GetMin(), 4u);
+	ASSERT_EQUAL(document_lengths.GetMax(), 7u);
+
+	server.RemoveDocument(1);
+	server.RemoveDocument(2);
+	const MemoryUsageReport emptied = server.MemoryUsage();
+	ASSERT_EQUAL(emptied.documents, 0u);
+	ASSERT_EQUAL(emptied.document_ids, 0u);
+	ASSERT(emptied.postings < filled.postings);
+	ASSERT_EQUAL(emptied.term_dictionary, filled.term_dictionary);
+	ASSERT_EQUAL(server.GetPostingLengthHistogram().GetCount(), 0u);
+}
+
+void TestIngestArena()
+{
+	ASSERT(SplitIntoWords("  curly   cat  "s) == vector<string_view>({"curly"sv, "cat"sv}));
+
+	SearchServer server("and with"s);
+	const string text = "curly cat and curly  tail"s;
+	server.AddDocument(1, string_view(text).substr(0, 19), DocumentStatus::ACTUAL, {1});
+	server.AddDocument(2, "dog"s, DocumentStatus::ACTUAL, {1});
+
+	const auto& frequencies = server.GetWordFrequencies(1);
+	ASSERT_EQUAL(frequencies.size(), 2u);
+	ASSERT(abs(frequencies.at("curly"sv) - 2.0 / 3.0) < SearchServer::EPSILON);
+	ASSERT(abs(frequencies.at("cat"sv) - 1.0 / 3.0) < SearchServer::EPSILON);
+
+	const MemoryUsageReport before = server.MemoryUsage();
+	server.RemoveDocument(std::execution::par, 1);
+	server.AddDocument(1, string_view(text).substr(0, 19), DocumentStatus::ACTUAL, {1});
+	ASSERT_EQUAL(server.MemoryUsage().GetTotal(), before.GetTotal());
+
+	SearchServer moved(std::move(server));
+	moved.AddDocument(3, "curly dog"s, DocumentStatus::ACTUAL, {1});
+	ASSERT_EQUAL(moved.FindTopDocuments("curly"s).size(), 2u);
+	ASSERT(moved.MemoryUsage().postings > before.postings);
+}
+
+void TestRemoveDocuments()
+{
+	const vector<string> texts = {"white cat and fancy collar"s, "fluffy cat fluffy tail"s, "groomed dog expressive eyes"s,
+		"groomed starling eugene"s, "fluffy dog and white collar"s, "cat dog starling"s};
+
+	SearchServer batch("and"s);
+	SearchServer parallel_batch("and"s);
+	SearchServer one_by_one("and"s);
+
+	for(int id = 0; id < static_cast<int>(texts.size()); ++id)
+	{
+		batch.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+		parallel_batch.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+		one_by_one.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+	}
+
+	batch.BuildImpactIndex();
+	batch.RemoveDocuments({4, 1, 1, 42});
+	parallel_batch.RemoveDocuments(std::execution::par, {1, 4});
+	one_by_one.RemoveDocument(1);
+	one_by_one.RemoveDocument(4);
+
+	ASSERT(!batch.HasImpactIndex());
+	ASSERT_EQUAL(batch.GetDocumentCount(), 4);
+	ASSERT_EQUAL(parallel_batch.GetDocumentCount(), 4);
+	ASSERT(vector<int>(batch.begin(), batch.end()) == vector<int>({0, 2, 3, 5}));
+	ASSERT(batch.GetCorpusStatistics().average_document_length == one_by_one.GetCorpusStatistics().average_document_length);
+
+	for(const auto& query : {"fluffy cat"s, "white collar -dog"s, "groomed starling"s, "dog"s})
+	{
+		const auto expected = one_by_one.FindTopDocuments(query);
+		const auto actual = batch.FindTopDocuments(query);
+		const auto parallel_actual = parallel_batch.FindTopDocuments(query);
+
+		ASSERT_EQUAL(actual.size(), expected.size());
+		ASSERT_EQUAL(parallel_actual.size(), expected.size());
+
+		for(size_t i = 0; i < expected.size(); ++i)
+		{
+			ASSERT_EQUAL(actual[i].id, expected[i].id);
+			ASSERT_EQUAL(parallel_actual[i].id, expected[i].id);
+			ASSERT(abs(actual[i].relevance - expected[i].relevance) < SearchServer::EPSILON);
+		}
+	}
+
+	ASSERT(batch.FindTopDocuments("fluffy"s).empty());
+}
+
+void TestConcurrentIndexBuilder()
+{
+	const vector<string> words = {"white"s, "cat"s, "fancy"s, "collar"s, "fluffy"s, "tail"s, "groomed"s, "dog"s, "eyes"s, "starling"s};
+	vector<string> texts;
+
+	for(int id = 0; id < 400; ++id)
+	{
+		texts.push_back(words[id % 10] + " and "s + words[id % 7] + " "s + words[id % 3] + " "s + words[id % 10]);
+	}
+
+	SearchServer expected("and"s);
+
+	for(int id = 0; id < static_cast<int>(texts.size()); ++id)
+	{
+		expected.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id}, true);
+	}
+
+	SearchServer server("and"s);
+	server.AddDocument(1000, "fluffy cat"s, DocumentStatus::ACTUAL, {1});
+	expected.AddDocument(1000, "fluffy cat"s, DocumentStatus::ACTUAL, {1});
+
+	{
+		ConcurrentIndexBuilder builder(server, 16);
+		vector<thread> producers;
+
+		for(int t = 0; t < 4; ++t)
+		{
+			producers.emplace_back([&, t]
+			{
+				for(int id = t; id < static_cast<int>(texts.size()); id += 4)
+				{
+					// The builder keeps its own copy of the words, so the text may go away.
+					const string text = texts[id];
+					builder.AddDocument(id, text, DocumentStatus::ACTUAL, {id}, true);
+				}
+			});
+		}
+
+		// Searching alongside ingest sees some prefix of every producer's documents.
+		const size_t found = builder.Search([](const SearchServer& s) { return s.FindTopDocuments("fluffy"s).size(); });
+		ASSERT(found >= 1u);
+
+		for(auto& producer : producers)
+		{
+			producer.join();
+		}
+
+		bool is_duplicate_rejected = false;
+
+		try
+		{
+			builder.AddDocument(1000, "dog"s, DocumentStatus::ACTUAL, {1});
+		}
+		catch(const invalid_argument&)
+		{
+			is_duplicate_rejected = true;
+		}
+
+		ASSERT(is_duplicate_rejected);
+
+		builder.Flush();
+		ASSERT_EQUAL(builder.Search([](const SearchServer& s) { return s.GetDocumentCount(); }), 401);
+		ASSERT(builder.GetRejectedIds().empty());
+	}
+
+	for(const auto& query : {"fluffy cat"s, "white collar -dog"s, "\"groomed eyes\""s, "starling"s})
+	{
+		const auto expected_documents = expected.FindTopDocuments(query);
+		const auto documents = server.FindTopDocuments(query);
+
+		ASSERT_EQUAL(documents.size(), expected_documents.size());
+
+		for(size_t i = 0; i < documents.size(); ++i)
+		{
+			ASSERT_EQUAL(documents[i].id, expected_documents[i].id);
+			ASSERT(abs(documents[i].relevance - expected_documents[i].relevance) < SearchServer::EPSILON);
+		}
+	}
+
+	{
+		SearchServer rejecting("and"s);
+		rejecting.SetDuplicateHandling(DuplicateHandling::REJECT);
+		rejecting.AddDocument(1, "fluffy cat"s, DocumentStatus::ACTUAL, {1});
+
+		ConcurrentIndexBuilder builder(rejecting, 1);
+		builder.AddDocument(2, "cat fluffy"s, DocumentStatus::ACTUAL, {1});
+		ASSERT(builder.GetRejectedIds() == vector<int>({2}));
+
+		// A rejected id was never indexed, so it can be taken by another document.
+		builder.AddDocument(2, "groomed dog"s, DocumentStatus::ACTUAL, {1});
+		ASSERT_EQUAL(builder.Search([](const SearchServer& s) { return s.GetDocumentCount(); }), 2);
+		ASSERT_EQUAL(builder.Search([](const SearchServer& s) { return s.FindTopDocuments("dog"s).size(); }), 1u);
+	}
+}
+
+void TestExplainTopDocuments()
+{
+	SearchServer server("and in"s);
+	server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {8});
+	server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7});
+	server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5});
+	server.AddDocument(4, "groomed cat in a collar"s, DocumentStatus::BANNED, {1});
+
+	const string query = "fluffy and groomed cat -collar"s;
+	const auto [documents, explanation] = server.ExplainTopDocuments(query);
+
+	const auto expected = server.FindTopDocuments(query);
+	ASSERT_EQUAL(documents.size(), expected.size());
+
+	for(size_t i = 0; i < documents.size(); ++i)
+	{
+		ASSERT_EQUAL(documents[i].id, expected[i].id);
+		ASSERT_EQUAL(documents[i].relevance, expected[i].relevance);
+	}
+
+	ASSERT_EQUAL(explanation.plus_terms.size(), 3u);
+	ASSERT_EQUAL(explanation.plus_terms[0].word, "cat"s);
+	ASSERT_EQUAL(explanation.plus_terms[0].posting_length, 3u);
+	ASSERT(abs(explanation.plus_terms[0].inverse_document_freq - log(4.0 / 3.0)) < SearchServer::EPSILON);
+	ASSERT_EQUAL(explanation.minus_terms.size(), 1u);
+	ASSERT_EQUAL(explanation.minus_terms[0].posting_length, 2u);
+	ASSERT(explanation.stop_words == vector<string>({"and"s}));
+
+	// Document 4 fails the status check; document 1 is scored and then dropped for "collar".
+	ASSERT_EQUAL(explanation.rejected_by_predicate, 1u);
+	ASSERT_EQUAL(explanation.candidates_scored, 3u);
+	ASSERT_EQUAL(explanation.removed_by_minus, 1u);
+	ASSERT_EQUAL(explanation.result_count, 2u);
+	ASSERT(!explanation.used_impact_index);
+
+	vector<string> stages;
+
+	for(const auto& [stage, duration] : explanation.stage_durations)
+	{
+		stages.push_back(stage);
+	}
+
+	ASSERT(stages == vector<string>({"parse"s, "postings"s, "minus"s, "sort"s}));
+	ASSERT(explanation.ToText().find("removed by minus 1\n"s) != string::npos);
+
+	const auto [parallel_documents, parallel_explanation] = server.ExplainTopDocuments(std::execution::par, query, [](int, DocumentStatus, int) { return true; });
+	ASSERT_EQUAL(parallel_documents.size(), 2u);
+	ASSERT_EQUAL(parallel_explanation.rejected_by_predicate, 0u);
+	ASSERT_EQUAL(parallel_explanation.removed_by_minus, 2u);
+
+	server.BuildImpactIndex();
+	SearchOptions options;
+	options.limit = 1;
+	const auto [impact_documents, impact_explanation] = server.ExplainTopDocuments(std::execution::seq, "cat"s, [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; }, options, TfIdfRanking{});
+	ASSERT_EQUAL(impact_documents.size(), 1u);
+	ASSERT(impact_explanation.used_impact_index);
+	ASSERT_EQUAL(impact_explanation.candidates_quantized, 2u);
+	ASSERT_EQUAL(impact_explanation.rejected_by_predicate, 1u);
+
+	// Each stage is timed on its own, so they are recorded in the order they ran.
+	vector<string> impact_stages;
+	for(const auto& [stage, duration] : impact_explanation.stage_durations)
+	{
+		impact_stages.push_back(stage);
+	}
+	ASSERT(impact_stages == vector<string>({"parse"s, "postings"s, "impact.rescore"s, "minus"s, "sort"s}));
+}
+
+void TestMatchAllWords()
+{
+	SearchServer server("and"s);
+	server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {8}, true);
+	server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7}, true);
+	server.AddDocument(3, "groomed dog fancy collar"s, DocumentStatus::ACTUAL, {5}, true);
+	server.AddDocument(4, "fancy cat with a collar and a tail"s, DocumentStatus::ACTUAL, {1}, true);
+
+	SearchOptions all;
+	all.match_mode = MatchMode::ALL;
+	const auto actual = [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; };
+	const auto ids = [&](const string& query)
+	{
+		vector<int> result;
+		for (const auto& document : server.FindTopDocuments(std::execution::seq, query, actual, all))
+		{
+			result.push_back(document.id);
+		}
+		sort(result.begin(), result.end());
+		return result;
+	};
+
+	ASSERT(ids("cat collar and"s) == vector<int>({1, 4}));
+	ASSERT(ids("cat collar -white"s) == vector<int>({4}));
+	ASSERT(ids("cat bird"s).empty());
+	// A prefix is matched by any of its expansions.
+	ASSERT(ids("fa* collar"s) == vector<int>({1, 3, 4}));
+	ASSERT(ids("fluf* ta*"s) == vector<int>({2}));
+	ASSERT(ids("\"fancy collar\" cat"s) == vector<int>({1}));
+
+	mt19937 generator(11);
+	vector<string> dictionary;
+	for (int i = 0; i < 40; ++i)
+	{
+		dictionary.push_back("w"s + to_string(i));
+	}
+
+	SearchServer corpus;
+	for (int id = 0; id < 1500; ++id)
+	{
+		string text;
+		const int length = uniform_int_distribution<int>(3, 20)(generator);
+		for (int i = 0; i < length; ++i)
+		{
+			const double u = uniform_real_distribution<double>(0, 1)(generator);
+			text += dictionary[static_cast<size_t>(pow(u, 2) * dictionary.size())] + " "s;
+		}
+		corpus.AddDocument(id, text, static_cast<DocumentStatus>(id % 3), {id % 7});
+	}
+
+	SearchOptions unlimited;
+	unlimited.limit = numeric_limits<size_t>::max();
+	SearchOptions unlimited_all = unlimited;
+	unlimited_all.match_mode = MatchMode::ALL;
+	const vector<string> queries = {"w0 w1"s, "w1 w5 w9"s, "w2 w30 -w0"s, "w3 w39"s, "w0 w1 w2 w3"s};
+
+	// The same documents and relevances as filtering the disjunctive results, with and
+	// without the impact index and in both layouts.
+	const auto check = [&]
+	{
+		for (const auto& query : queries)
+		{
+			const size_t plus_count = count(query.begin(), query.end(), ' ') + 1 - count(query.begin(), query.end(), '-');
+			const auto any = corpus.FindTopDocuments(std::execution::seq, query, actual, unlimited);
+			const auto matched = corpus.FindTopDocuments(std::execution::par, query, actual, unlimited_all);
+			vector<Document> expected;
+
+			for (const auto& document : any)
+			{
+				if (get<0>(corpus.MatchDocument(query, document.id)).size() == plus_count)
+				{
+					expected.push_back(document);
+				}
+			}
+
+			ASSERT_EQUAL(matched.size(), expected.size());
+			for (size_t i = 0; i < matched.size(); ++i)
+			{
+				ASSERT_EQUAL(matched[i].id, expected[i].id);
+				ASSERT_EQUAL(matched[i].relevance, expected[i].relevance);
+			}
+		}
+	};
+
+	check();
+	corpus.BuildImpactIndex();
+	check();
+	corpus.BuildImpactIndex(ImpactLayout::IMPACT_ORDERED);
+	check();
+}
+
+void TestAdaptivePolicy()
+{
+	AdaptivePolicy levels;
+	levels.search_levels = {{2, 100}, {4, 1000}};
+	ASSERT_EQUAL(levels.SelectThreadCount(0), 1u);
+	ASSERT_EQUAL(levels.SelectThreadCount(100), 2u);
+	ASSERT_EQUAL(levels.SelectThreadCount(999), 2u);
+	ASSERT_EQUAL(levels.SelectThreadCount(5000), 4u);
+
+	mt19937 generator(5);
+	SearchServer server("w0"s);
+	for (int id = 0; id < 800; ++id)
+	{
+		string text;
+		const int length = uniform_int_distribution<int>(2, 25)(generator);
+		for (int i = 0; i < length; ++i)
+		{
+			text += "w"s + to_string(uniform_int_distribution<int>(0, 60)(generator)) + " "s;
+		}
+		server.AddDocument(id, text, static_cast<DocumentStatus>(id % 2), {id % 9});
+	}
+
+	// Every search runs on the pool, every match in parallel.
+	AdaptivePolicy parallel;
+	parallel.search_levels = {{2, 0}, {4, 0}};
+	parallel.min_parallel_match_words = 0;
+
+	for (const auto& query : {"w1 w2 w3 w4 w5"s, "w7 -w8"s, "w9"s, "w10 w11 w12 -w13 w14"s})
+	{
+		const auto expected = server.FindTopDocuments(std::execution::seq, query);
+
+		for (const auto& policy : {AdaptivePolicy{}, parallel})
+		{
+			const auto documents = server.FindTopDocuments(policy, query);
+			ASSERT_EQUAL(documents.size(), expected.size());
+
+			for (size_t i = 0; i < documents.size(); ++i)
+			{
+				ASSERT_EQUAL(documents[i].id, expected[i].id);
+				ASSERT(abs(documents[i].relevance - expected[i].relevance) < SearchServer::EPSILON);
+			}
+
+			for (const int document_id : {3, 400, 799})
+			{
+				auto [words, status] = server.MatchDocument(policy, query, document_id);
+				auto [expected_words, expected_status] = server.MatchDocument(std::execution::seq, query, document_id);
+				sort(words.begin(), words.end());
+				sort(expected_words.begin(), expected_words.end());
+				ASSERT(words == expected_words);
+				ASSERT(status == expected_status);
+			}
+		}
+	}
+
+	const AdaptivePolicy calibrated = server.CalibrateAdaptivePolicy();
+	for (size_t i = 1; i < calibrated.search_levels.size(); ++i)
+	{
+		ASSERT(calibrated.search_levels[i - 1].first < calibrated.search_levels[i].first);
+		ASSERT(calibrated.search_levels[i - 1].second <= calibrated.search_levels[i].second);
+	}
+	ASSERT_EQUAL(server.FindTopDocuments(calibrated, "w1 w2"s).size(), server.FindTopDocuments("w1 w2"s).size());
+}
+
 void TestSearchServer()
 {
 	RUN_TEST(TestFindDocument);
@@ -328,6 +1618,27 @@ void TestSearchServer()
 	RUN_TEST(TestStatus);
 	RUN_TEST(TestRelevanceCorrect);
 	RUN_TEST(TestDocumentsMatching);
+	RUN_TEST(TestDuplicatedIds);
+	RUN_TEST(TestNearDuplicateClusters);
+	RUN_TEST(TestIncrementalDuplicateTracking);
+	RUN_TEST(TestProcessQueries);
+	RUN_TEST(TestQueryService);
+	RUN_TEST(TestRequestQueue);
+	RUN_TEST(TestSlowQueryLog);
+	RUN_TEST(TestMetrics);
+	RUN_TEST(TestSearchPagination);
+	RUN_TEST(TestPhraseQueries);
+	RUN_TEST(TestPrefixQueries);
+	RUN_TEST(TestFuzzyQueries);
+	RUN_TEST(TestRankingPolicies);
+	RUN_TEST(TestImpactIndex);
+	RUN_TEST(TestMemoryUsage);
+	RUN_TEST(TestIngestArena);
+	RUN_TEST(TestRemoveDocuments);
+	RUN_TEST(TestConcurrentIndexBuilder);
+	RUN_TEST(TestExplainTopDocuments);
+	RUN_TEST(TestMatchAllWords);
+	RUN_TEST(TestAdaptivePolicy);
 }
 
 
@@ -381,13 +1692,11 @@ void FindTopDocuments(const SearchServer& search_server, const std::string& raw_
 
 void MatchDocuments(const SearchServer& search_server, const std::string& query)
 {
-	SearchServer server = static_cast<SearchServer>(search_server);
-
 	try
 	{
 		std::cout << "Матчинг документов по запросу: "s << query << std::endl;
 
-		for(const auto document_id : server)
+		for(const auto document_id : search_server)
 		{
 			const auto [words, status] = search_server.MatchDocument(query, document_id);
 			PrintMatchDocumentResult(document_id, words, status);
@@ -400,175 +1709,6 @@ void MatchDocuments(const SearchServer& search_server, const std::string& query)
 }
 
 
-/*string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution('a', 'z')(generator));
-    }
-    return word;
-}
-
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
-    }
-    sort(words.begin(), words.end());
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
-}
-
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int max_word_count) {
-    const int word_count = uniform_int_distribution(1, max_word_count)(generator);
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
-        }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
-    }
-    return query;
-}
-
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
-    }
-    return queries;
-}
-
-template <typename ExecutionPolicy>
-void Test(string_view mark, SearchServer search_server, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
-    const int document_count = search_server.GetDocumentCount();
-    for (int id = 0; id < document_count; ++id) {
-        search_server.RemoveDocument(policy, id);
-    }
-    cout << search_server.GetDocumentCount() << endl;
-}
-
-#define TEST(mode) Test(#mode, search_server, execution::mode)*/
-
-/*string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution('a', 'z')(generator));
-    }
-    return word;
-}
-
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
-    }
-    sort(words.begin(), words.end());
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
-}
-
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
-        }
-        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
-            query.push_back('-');
-        }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
-    }
-    return query;
-}
-
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
-    }
-    return queries;
-}
-
-template <typename ExecutionPolicy>
-void Test(string_view mark, SearchServer search_server, const string& query, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
-    const int document_count = search_server.GetDocumentCount();
-    int word_count = 0;
-    for (int id = 0; id < document_count; ++id) {
-        const auto [words, status] = search_server.MatchDocument(policy, query, id);
-        word_count += words.size();
-    }
-    cout << word_count << endl;
-}
-
-#define TEST(policy) Test(#policy, search_server, query, execution::policy);*/
-
-string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution('a', 'z')(generator));
-    }
-    return word;
-}
-
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
-    }
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
-}
-
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
-        }
-        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
-            query.push_back('-');
-        }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
-    }
-    return query;
-}
-
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
-    }
-    return queries;
-}
-
-template <typename ExecutionPolicy>
-void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
-    double total_relevance = 0;
-    for (const string_view query : queries) {
-        for (const auto& document : search_server.FindTopDocuments(policy, query)) {
-            total_relevance += document.relevance;
-        }
-    }
-    cout << total_relevance << endl;
-}
-
-#define TEST(policy) Test(#policy, search_server, queries, execution::policy)
-
 int main()
 {
 	/*TestSearchServer();
@@ -652,51 +1792,6 @@ int main()
 
 	}*/
 
-	/*{
-		mt19937 generator;
-
-		const auto dictionary = GenerateDictionary(generator, 10000, 25);
-		const auto documents = GenerateQueries(generator, dictionary, 10000, 100);
-
-		{
-			SearchServer search_server(dictionary[0]);
-			for (size_t i = 0; i < documents.size(); ++i) {
-				search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
-			}
-
-			TEST(seq);
-
-			std::cout << "test 1" << "\n";
-		}
-		{
-			SearchServer search_server(dictionary[0]);
-			for (size_t i = 0; i < documents.size(); ++i) {
-				search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
-			}
-
-			TEST(par);
-
-			std::cout << "test 2" << "\n";
-		}
-	}*/
-
-    /*{
-        mt19937 generator;
-
-        const auto dictionary = GenerateDictionary(generator, 1000, 10);
-        const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
-
-        const string query = GenerateQuery(generator, dictionary, 500, 0.1);
-
-        SearchServer search_server(dictionary[0]);
-        for (size_t i = 0; i < documents.size(); ++i) {
-                search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
-        }
-
-        TEST(seq);
-        TEST(par);
-    }*/
-    
     {
         SearchServer search_server("and with"s);
 
@@ -770,22 +1865,4 @@ int main()
             PrintDocument(document);
         }
     }
-
-    {
-        mt19937 generator;
-
-        const auto dictionary = GenerateDictionary(generator, 1000, 10);
-        const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
-
-        SearchServer search_server(dictionary[0]);
-        for (size_t i = 0; i < documents.size(); ++i) {
-            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
-        }
-
-        const auto queries = GenerateQueries(generator, dictionary, 100, 70);
-
-        TEST(seq);
-        TEST(par);
-    }
-    
 }
@@ -0,0 +1,83 @@
+#include <sstream>
+#include "memory_accounting.h"
+
+CountingMemoryResource::CountingMemoryResource(std::pmr::memory_resource* upstream)
+	: upstream_(upstream)
+{
+}
+
+size_t CountingMemoryResource::GetBytes() const
+{
+	return bytes_.load(std::memory_order_relaxed);
+}
+
+size_t CountingMemoryResource::GetPeakBytes() const
+{
+	return peak_bytes_.load(std::memory_order_relaxed);
+}
+
+size_t CountingMemoryResource::GetAllocationCount() const
+{
+	return allocation_count_.load(std::memory_order_relaxed);
+}
+
+std::pmr::memory_resource* CountingMemoryResource::GetUpstream() const
+{
+	return upstream_;
+}
+
+void* CountingMemoryResource::do_allocate(size_t bytes, size_t alignment)
+{
+	void* pointer = upstream_->allocate(bytes, alignment);
+
+	const size_t total = bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	allocation_count_.fetch_add(1, std::memory_order_relaxed);
+
+	size_t peak = peak_bytes_.load(std::memory_order_relaxed);
+
+	while(peak < total && !peak_bytes_.compare_exchange_weak(peak, total, std::memory_order_relaxed))
+	{
+	}
+
+	return pointer;
+}
+
+void CountingMemoryResource::DiscardDeallocations()
+{
+	discard_deallocations_ = true;
+}
+
+void CountingMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+	if(!discard_deallocations_)
+	{
+		upstream_->deallocate(pointer, bytes, alignment);
+	}
+
+	bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+	allocation_count_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool CountingMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+	return this == &other;
+}
+
+size_t MemoryUsageReport::GetTotal() const
+{
+	return term_dictionary + postings + documents + document_ids + stop_words;
+}
+
+std::string MemoryUsageReport::ToText() const
+{
+	std::ostringstream stream;
+
+	stream << "term_dictionary " << term_dictionary << '\n'
+		   << "postings " << postings << '\n'
+		   << "documents " << documents << '\n'
+		   << "document_ids " << document_ids << '\n'
+		   << "stop_words " << stop_words << '\n'
+		   << "total " << GetTotal() << '\n';
+
+	return stream.str();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+
+// Forwards to an upstream resource and counts what passes through it. Bytes are the sizes
+// containers asked for, without the upstream allocator's own headers or rounding.
+class CountingMemoryResource : public std::pmr::memory_resource
+{
+public:
+	explicit CountingMemoryResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+	size_t GetBytes() const;
+	size_t GetPeakBytes() const;
+	// Blocks currently allocated.
+	size_t GetAllocationCount() const;
+
+	std::pmr::memory_resource* GetUpstream() const;
+
+	// For owners about to release the upstream wholesale: later deallocations are skipped,
+	// so destroying the containers only walks them instead of returning every node.
+	void DiscardDeallocations();
+
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+	std::pmr::memory_resource* upstream_;
+	std::atomic<size_t> bytes_ = 0;
+	std::atomic<size_t> peak_bytes_ = 0;
+	std::atomic<size_t> allocation_count_ = 0;
+	bool discard_deallocations_ = false;
+};
+
+// Bytes held by each part of a SearchServer index, as counted by its CountingMemoryResources.
+struct MemoryUsageReport
+{
+	size_t term_dictionary = 0;
+	size_t postings = 0;
+	size_t documents = 0;
+	size_t document_ids = 0;
+	size_t stop_words = 0;
+
+	size_t GetTotal() const;
+
+	std::string ToText() const;
+};
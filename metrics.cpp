@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "metrics.h"
+
+void LatencyHistogram::Record(uint64_t value, uint64_t count)
+{
+	if(count == 0)
+	{
+		return;
+	}
+
+	counts_[GetBucketIndex(value)] += count;
+	count_ += count;
+	sum_ += value * count;
+	min_ = std::min(min_, value);
+	max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+	for(size_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		counts_[i] += other.counts_[i];
+	}
+
+	count_ += other.count_;
+	sum_ += other.sum_;
+	min_ = std::min(min_, other.min_);
+	max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+	return count_;
+}
+
+uint64_t LatencyHistogram::GetMin() const
+{
+	return count_ == 0 ? 0 : min_;
+}
+
+uint64_t LatencyHistogram::GetMax() const
+{
+	return max_;
+}
+
+double LatencyHistogram::GetMean() const
+{
+	return count_ == 0 ? 0.0 : sum_ * 1.0 / count_;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const
+{
+	if(count_ == 0)
+	{
+		return 0;
+	}
+
+	const double clamped = std::clamp(percentile, 0.0, 100.0);
+	const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(clamped / 100.0 * count_ + 0.5));
+	uint64_t seen = 0;
+
+	for(size_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		seen += counts_[i];
+
+		if(seen >= rank)
+		{
+			return std::clamp(GetBucketUpperBound(i), GetMin(), max_);
+		}
+	}
+
+	return max_;
+}
+
+size_t LatencyHistogram::GetBucketIndex(uint64_t value)
+{
+	if(value < SUB_BUCKET_COUNT)
+	{
+		return static_cast<size_t>(value);
+	}
+
+	const int top_bit = 63 - __builtin_clzll(value);
+	const int shift = top_bit - SUB_BUCKET_BITS;
+
+	return (shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) & (SUB_BUCKET_COUNT - 1));
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index)
+{
+	if(index < SUB_BUCKET_COUNT)
+	{
+		return index;
+	}
+
+	const int shift = static_cast<int>(index / SUB_BUCKET_COUNT) - 1;
+	const uint64_t sub_bucket = (index % SUB_BUCKET_COUNT) | SUB_BUCKET_COUNT;
+	const uint64_t lower_bound = sub_bucket << shift;
+
+	return lower_bound + ((uint64_t(1) << shift) - 1);
+}
+
+namespace
+{
+	void AppendJsonString(std::ostringstream& out, std::string_view text)
+	{
+		out << '"';
+
+		for(const char c : text)
+		{
+			if(c == '"' || c == '\\')
+			{
+				out << '\\' << c;
+			}
+			else if(static_cast<unsigned char>(c) < ' ')
+			{
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+			}
+			else
+			{
+				out << c;
+			}
+		}
+
+		out << '"';
+	}
+}
+
+std::string MetricsSnapshot::ToText() const
+{
+	std::ostringstream out;
+
+	for(const auto& [name, histogram] : histograms)
+	{
+		out << name << " count=" << histogram.GetCount() << " mean_ns=" << static_cast<uint64_t>(histogram.GetMean())
+			<< " p50_ns=" << histogram.GetPercentile(50) << " p90_ns=" << histogram.GetPercentile(90)
+			<< " p99_ns=" << histogram.GetPercentile(99) << " p999_ns=" << histogram.GetPercentile(99.9)
+			<< " max_ns=" << histogram.GetMax() << '\n';
+	}
+
+	return out.str();
+}
+
+std::string MetricsSnapshot::ToJson() const
+{
+	std::ostringstream out;
+	out << '{';
+	bool is_first = true;
+
+	for(const auto& [name, histogram] : histograms)
+	{
+		if(!is_first)
+		{
+			out << ',';
+		}
+		is_first = false;
+
+		AppendJsonString(out, name);
+		out << ":{\"count\":" << histogram.GetCount() << ",\"mean_ns\":" << static_cast<uint64_t>(histogram.GetMean())
+			<< ",\"min_ns\":" << histogram.GetMin() << ",\"p50_ns\":" << histogram.GetPercentile(50)
+			<< ",\"p90_ns\":" << histogram.GetPercentile(90) << ",\"p99_ns\":" << histogram.GetPercentile(99)
+			<< ",\"p999_ns\":" << histogram.GetPercentile(99.9) << ",\"max_ns\":" << histogram.GetMax() << '}';
+	}
+
+	out << '}';
+	return out.str();
+}
+
+// Counters are written only by the owning thread (plain load + store, no locked instructions)
+// and read concurrently by Snapshot, hence relaxed atomics.
+struct MetricsRegistry::HistogramShard
+{
+	std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> counts{};
+	std::atomic<uint64_t> sum{0};
+	std::atomic<uint64_t> min{UINT64_MAX};
+	std::atomic<uint64_t> max{0};
+
+	void Record(uint64_t value)
+	{
+		auto& bucket = counts[LatencyHistogram::GetBucketIndex(value)];
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+
+		if(value < min.load(std::memory_order_relaxed))
+		{
+			min.store(value, std::memory_order_relaxed);
+		}
+		if(value > max.load(std::memory_order_relaxed))
+		{
+			max.store(value, std::memory_order_relaxed);
+		}
+	}
+
+	void AddTo(LatencyHistogram& histogram) const
+	{
+		uint64_t count = 0;
+
+		for(size_t i = 0; i < counts.size(); ++i)
+		{
+			const uint64_t bucket_count = counts[i].load(std::memory_order_relaxed);
+			histogram.counts_[i] += bucket_count;
+			count += bucket_count;
+		}
+
+		if(count == 0)
+		{
+			return;
+		}
+
+		histogram.count_ += count;
+		histogram.sum_ += sum.load(std::memory_order_relaxed);
+		histogram.min_ = std::min(histogram.min_, min.load(std::memory_order_relaxed));
+		histogram.max_ = std::max(histogram.max_, max.load(std::memory_order_relaxed));
+	}
+};
+
+struct MetricsRegistry::ThreadShards
+{
+	std::array<std::atomic<HistogramShard*>, MAX_METRICS> shards{};
+
+	~ThreadShards()
+	{
+		MetricsRegistry::Instance().Retire(*this);
+	}
+};
+
+MetricsRegistry& MetricsRegistry::Instance()
+{
+	// Never destroyed, so threads that finish during static destruction can still retire their shards.
+	static MetricsRegistry* registry = new MetricsRegistry();
+	return *registry;
+}
+
+size_t MetricsRegistry::GetMetricId(std::string_view name)
+{
+	const std::lock_guard<std::mutex> lock(mutex_);
+
+	const auto it = metric_ids_.find(name);
+
+	if(it != metric_ids_.end())
+	{
+		return it->second;
+	}
+
+	if(metric_names_.size() == MAX_METRICS)
+	{
+		throw std::length_error("too many metrics registered");
+	}
+
+	const size_t id = metric_names_.size();
+	metric_ids_.emplace(std::string(name), id);
+	metric_names_.emplace_back(name);
+	retired_.emplace_back();
+
+	return id;
+}
+
+void MetricsRegistry::Record(size_t metric_id, uint64_t value)
+{
+	auto& slot = GetThreadShards().shards.at(metric_id);
+	HistogramShard* shard = slot.load(std::memory_order_acquire);
+
+	if(shard == nullptr)
+	{
+		shard = new HistogramShard();
+		slot.store(shard, std::memory_order_release);
+	}
+
+	shard->Record(value);
+}
+
+void MetricsRegistry::Record(std::string_view name, uint64_t value)
+{
+	Record(GetMetricId(name), value);
+}
+
+MetricsSnapshot MetricsRegistry::Snapshot() const
+{
+	const std::lock_guard<std::mutex> lock(mutex_);
+	MetricsSnapshot result;
+
+	for(size_t id = 0; id < metric_names_.size(); ++id)
+	{
+		LatencyHistogram histogram = retired_[id];
+
+		for(const ThreadShards* thread : live_threads_)
+		{
+			if(const HistogramShard* shard = thread->shards[id].load(std::memory_order_acquire))
+			{
+				shard->AddTo(histogram);
+			}
+		}
+
+		if(histogram.GetCount() != 0)
+		{
+			result.histograms.emplace(metric_names_[id], histogram);
+		}
+	}
+
+	return result;
+}
+
+void MetricsRegistry::Reset()
+{
+	// Owners must not be recording (see metrics.h); the stores below would race with them.
+	const std::lock_guard<std::mutex> lock(mutex_);
+
+	std::fill(retired_.begin(), retired_.end(), LatencyHistogram());
+
+	for(ThreadShards* thread : live_threads_)
+	{
+		for(auto& slot : thread->shards)
+		{
+			if(HistogramShard* shard = slot.load(std::memory_order_acquire))
+			{
+				for(auto& count : shard->counts)
+				{
+					count.store(0, std::memory_order_relaxed);
+				}
+				shard->sum.store(0, std::memory_order_relaxed);
+				shard->min.store(UINT64_MAX, std::memory_order_relaxed);
+				shard->max.store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+}
+
+MetricsRegistry::ThreadShards& MetricsRegistry::GetThreadShards()
+{
+	thread_local ThreadShards* shards = nullptr;
+
+	if(shards == nullptr)
+	{
+		thread_local ThreadShards storage;
+		shards = &storage;
+
+		const std::lock_guard<std::mutex> lock(mutex_);
+		live_threads_.push_back(shards);
+	}
+
+	return *shards;
+}
+
+void MetricsRegistry::Retire(ThreadShards& shards)
+{
+	const std::lock_guard<std::mutex> lock(mutex_);
+
+	for(size_t id = 0; id < shards.shards.size(); ++id)
+	{
+		if(HistogramShard* shard = shards.shards[id].exchange(nullptr, std::memory_order_acq_rel))
+		{
+			shard->AddTo(retired_[id]);
+			delete shard;
+		}
+	}
+
+	live_threads_.erase(std::remove(live_threads_.begin(), live_threads_.end(), &shards), live_threads_.end());
+}
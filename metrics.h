@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Log-linear (HDR-style) histogram: 16 linear sub-buckets per power of two, so any recorded
+// value is reported with at most 1/16 relative error. Values are nanoseconds by convention.
+class LatencyHistogram
+{
+public:
+	inline static constexpr int SUB_BUCKET_BITS = 4;
+	inline static constexpr size_t SUB_BUCKET_COUNT = size_t(1) << SUB_BUCKET_BITS;
+	inline static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+	void Record(uint64_t value, uint64_t count = 1);
+	void Merge(const LatencyHistogram& other);
+
+	uint64_t GetCount() const;
+	uint64_t GetMin() const;
+	uint64_t GetMax() const;
+	double GetMean() const;
+	uint64_t GetPercentile(double percentile) const;
+
+	static size_t GetBucketIndex(uint64_t value);
+	static uint64_t GetBucketUpperBound(size_t index);
+
+private:
+	friend class MetricsRegistry;
+
+	std::array<uint64_t, BUCKET_COUNT> counts_{};
+	uint64_t count_ = 0;
+	uint64_t sum_ = 0;
+	uint64_t min_ = UINT64_MAX;
+	uint64_t max_ = 0;
+};
+
+struct MetricsSnapshot
+{
+	std::map<std::string, LatencyHistogram> histograms;
+
+	std::string ToText() const;
+	std::string ToJson() const;
+};
+
+// Process-wide registry of named latency histograms. Every thread records into its own shard
+// without locking; Snapshot merges the shards of live and finished threads.
+class MetricsRegistry
+{
+public:
+	inline static constexpr size_t MAX_METRICS = 256;
+
+	static MetricsRegistry& Instance();
+
+	size_t GetMetricId(std::string_view name);
+
+	void Record(size_t metric_id, uint64_t value);
+	void Record(std::string_view name, uint64_t value);
+
+	MetricsSnapshot Snapshot() const;
+
+	// Zeroes every histogram. Only for quiescent moments, e.g. between benchmark runs: shards
+	// are updated by plain load + store, so a sample recorded concurrently may write back the
+	// count it read before the reset.
+	void Reset();
+
+private:
+	struct HistogramShard;
+	struct ThreadShards;
+
+	MetricsRegistry() = default;
+
+	mutable std::mutex mutex_;
+	std::map<std::string, size_t, std::less<>> metric_ids_;
+	std::vector<std::string> metric_names_;
+	std::vector<ThreadShards*> live_threads_;
+	std::vector<LatencyHistogram> retired_;
+
+	ThreadShards& GetThreadShards();
+	void Retire(ThreadShards& shards);
+};
+
+class ScopedMetricTimer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit ScopedMetricTimer(size_t metric_id) : metric_id_(metric_id) {}
+	explicit ScopedMetricTimer(std::string_view name) : metric_id_(MetricsRegistry::Instance().GetMetricId(name)) {}
+
+	~ScopedMetricTimer()
+	{
+		MetricsRegistry::Instance().Record(metric_id_, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_).count());
+	}
+
+private:
+	const size_t metric_id_;
+	const Clock::time_point start_time_ = Clock::now();
+};
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+
+// Times the rest of the enclosing scope into the histogram called `name` (a string literal).
+// Building with SEARCH_SERVER_NO_METRICS compiles the instrumentation out.
+// RECORD_VALUE adds a single non-duration sample, e.g. how many terms a query expanded to.
+#ifdef SEARCH_SERVER_NO_METRICS
+#define RECORD_DURATION(name) do {} while (false)
+#define RECORD_VALUE(name, value) do {} while (false)
+#else
+#define RECORD_DURATION(name) \
+	static const size_t METRICS_CONCAT(metricId, __LINE__) = MetricsRegistry::Instance().GetMetricId(name); \
+	ScopedMetricTimer METRICS_CONCAT(metricTimer, __LINE__)(METRICS_CONCAT(metricId, __LINE__))
+#define RECORD_VALUE(name, value) \
+	do \
+	{ \
+		static const size_t metricId = MetricsRegistry::Instance().GetMetricId(name); \
+		MetricsRegistry::Instance().Record(metricId, (value)); \
+	} while (false)
+#endif
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <execution>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include "near_duplicates.h"
+#include "document_fingerprint.h"
+
+namespace
+{
+	class DisjointSets
+	{
+	public:
+		explicit DisjointSets(size_t size) : parents_(size)
+		{
+			std::iota(parents_.begin(), parents_.end(), 0);
+		}
+
+		size_t Find(size_t item)
+		{
+			while(parents_[item] != item)
+			{
+				parents_[item] = parents_[parents_[item]];
+				item = parents_[item];
+			}
+			return item;
+		}
+
+		void Unite(size_t lhs, size_t rhs)
+		{
+			lhs = Find(lhs);
+			rhs = Find(rhs);
+
+			if(lhs != rhs)
+			{
+				parents_[std::max(lhs, rhs)] = std::min(lhs, rhs);
+			}
+		}
+
+	private:
+		std::vector<size_t> parents_;
+	};
+
+	uint64_t HashBand(const std::vector<uint32_t>& signature, int band, int rows_per_band)
+	{
+		uint64_t hash = 0xCBF29CE484222325ull ^ static_cast<uint64_t>(band);
+
+		for(int row = band * rows_per_band; row < (band + 1) * rows_per_band; ++row)
+		{
+			hash ^= signature[row];
+			hash *= 0x100000001B3ull;
+			hash ^= hash >> 29;
+		}
+
+		return hash;
+	}
+}
+
+MinHasher::MinHasher(int hash_count) : hash_count_(hash_count)
+{
+	if(hash_count <= 0)
+	{
+		throw std::invalid_argument("MinHash signature must contain at least one hash");
+	}
+}
+
+std::vector<uint32_t> MinHasher::ComputeSignature(const std::pmr::unordered_set<std::string_view>& words) const
+{
+	std::vector<uint32_t> signature(hash_count_, std::numeric_limits<uint32_t>::max());
+
+	// Every hash function is derived from the two halves of the word fingerprint (h1 + i * h2),
+	// so each word is hashed once regardless of the signature length.
+	for(const auto word : words)
+	{
+		const DocumentFingerprint fingerprint = ComputeWordFingerprint(word);
+		uint64_t hash = fingerprint.high;
+
+		for(int i = 0; i < hash_count_; ++i)
+		{
+			const uint64_t mixed = (hash ^ (hash >> 31)) * 0x9E3779B97F4A7C15ull;
+			signature[i] = std::min(signature[i], static_cast<uint32_t>(mixed >> 32));
+			hash += fingerprint.low;
+		}
+	}
+
+	return signature;
+}
+
+double MinHasher::EstimateSimilarity(const std::vector<uint32_t>& lhs, const std::vector<uint32_t>& rhs)
+{
+	if(lhs.empty() || lhs.size() != rhs.size())
+	{
+		return 0.0;
+	}
+
+	size_t equal_count = 0;
+
+	for(size_t i = 0; i < lhs.size(); ++i)
+	{
+		equal_count += lhs[i] == rhs[i];
+	}
+
+	return equal_count * 1.0 / lhs.size();
+}
+
+std::vector<std::vector<int>> FindNearDuplicateClusters(const std::vector<int>& document_ids,
+														const std::vector<const std::pmr::unordered_set<std::string_view>*>& document_words,
+														const NearDuplicateOptions& options)
+{
+	if(options.band_count <= 0 || options.rows_per_band <= 0)
+	{
+		throw std::invalid_argument("LSH band count and rows per band must be positive");
+	}
+
+	const MinHasher hasher(options.band_count * options.rows_per_band);
+
+	std::vector<std::vector<uint32_t>> signatures(document_words.size());
+
+	std::transform(std::execution::par, document_words.begin(), document_words.end(), signatures.begin(), [&hasher](const auto* words)
+	{
+		return hasher.ComputeSignature(*words);
+	});
+
+	DisjointSets clusters(document_ids.size());
+
+	for(int band = 0; band < options.band_count; ++band)
+	{
+		std::unordered_map<uint64_t, std::vector<size_t>> buckets;
+		buckets.reserve(document_ids.size());
+
+		for(size_t i = 0; i < signatures.size(); ++i)
+		{
+			if(!document_words[i]->empty())
+			{
+				buckets[HashBand(signatures[i], band, options.rows_per_band)].push_back(i);
+			}
+		}
+
+		std::vector<size_t> representatives;
+
+		for(const auto& [_, bucket] : buckets)
+		{
+			// Each member is verified against one representative per cluster formed in the
+			// bucket so far rather than against every other member, so a bucket of k
+			// near-copies costs O(k) estimates instead of O(k^2).
+			representatives.clear();
+
+			for(const size_t member : bucket)
+			{
+				bool is_clustered = false;
+
+				for(const size_t representative : representatives)
+				{
+					// Joined through another band or a transitive match: nothing to verify.
+					if(clusters.Find(representative) == clusters.Find(member)
+						|| MinHasher::EstimateSimilarity(signatures[representative], signatures[member]) >= options.similarity_threshold)
+					{
+						clusters.Unite(representative, member);
+						is_clustered = true;
+						break;
+					}
+				}
+
+				if(!is_clustered)
+				{
+					representatives.push_back(member);
+				}
+			}
+		}
+	}
+
+	std::map<size_t, std::vector<int>> grouped;
+
+	for(size_t i = 0; i < document_ids.size(); ++i)
+	{
+		grouped[clusters.Find(i)].push_back(document_ids[i]);
+	}
+
+	std::vector<std::vector<int>> result;
+
+	for(auto& [_, ids] : grouped)
+	{
+		if(ids.size() > 1)
+		{
+			std::sort(ids.begin(), ids.end());
+			result.push_back(std::move(ids));
+		}
+	}
+
+	std::sort(result.begin(), result.end(), [](const auto& lhs, const auto& rhs) { return lhs.front() < rhs.front(); });
+
+	return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <memory_resource>
+#include <unordered_set>
+#include <vector>
+
+struct NearDuplicateOptions
+{
+	// band_count * rows_per_band MinHash values are kept per document. Documents become
+	// candidates when any band matches, roughly at Jaccard (1 / band_count) ^ (1 / rows_per_band).
+	int band_count = 12;
+	int rows_per_band = 6;
+	double similarity_threshold = 0.8;
+};
+
+class MinHasher
+{
+public:
+	explicit MinHasher(int hash_count);
+
+	std::vector<uint32_t> ComputeSignature(const std::pmr::unordered_set<std::string_view>& words) const;
+
+	static double EstimateSimilarity(const std::vector<uint32_t>& lhs, const std::vector<uint32_t>& rhs);
+
+private:
+	int hash_count_;
+};
+
+// Groups documents whose estimated Jaccard similarity reaches options.similarity_threshold.
+// Only clusters of two or more documents are returned, each sorted by id, ordered by their lowest id.
+std::vector<std::vector<int>> FindNearDuplicateClusters(const std::vector<int>& document_ids,
+														const std::vector<const std::pmr::unordered_set<std::string_view>*>& document_words,
+														const NearDuplicateOptions& options);
@@ -4,6 +4,8 @@
 #include <vector>
 #include <algorithm>
 #include <cassert>
+#include <iterator>
+#include <cstddef>
 #include "test_framework.h"
 
 
@@ -68,6 +70,105 @@ private:
 	std::vector<PaginatorRange<It>> pages;
 };
 
+// Pages over a result list that is produced on demand: fetch(last, page_size) returns
+// the page that follows the item last (nullptr for the first page). Iteration stops
+// at the first empty or short page, so nothing past the visited pages is computed.
+template<typename Item, typename Fetch>
+class LazyPaginator
+{
+public:
+
+	class Iterator
+	{
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = std::vector<Item>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type*;
+		using reference = const value_type&;
+
+		Iterator() = default;
+
+		explicit Iterator(const LazyPaginator* paginator)
+			: paginator_(paginator)
+		{
+			Load(nullptr);
+		}
+
+		reference operator*() const
+		{
+			return page_;
+		}
+
+		pointer operator->() const
+		{
+			return &page_;
+		}
+
+		Iterator& operator++()
+		{
+			if (page_.size() < paginator_->page_size_)
+			{
+				paginator_ = nullptr;
+				page_.clear();
+			}
+			else
+			{
+				const Item last = page_.back();
+				Load(&last);
+			}
+
+			return *this;
+		}
+
+		bool operator==(const Iterator& other) const
+		{
+			return paginator_ == other.paginator_;
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+
+		void Load(const Item* last)
+		{
+			page_ = paginator_->fetch_(last, paginator_->page_size_);
+
+			if (page_.empty())
+			{
+				paginator_ = nullptr;
+			}
+		}
+
+		const LazyPaginator* paginator_ = nullptr;
+		std::vector<Item> page_;
+	};
+
+	LazyPaginator(size_t page_size, Fetch fetch)
+		: page_size_(page_size), fetch_(std::move(fetch))
+	{
+		assert(page_size > 0);
+	}
+
+	Iterator begin() const
+	{
+		return Iterator(this);
+	}
+
+	Iterator end() const
+	{
+		return Iterator();
+	}
+
+private:
+
+	size_t page_size_;
+	Fetch fetch_;
+};
+
 template<typename T>
 std::ostream& operator<<(std::ostream& stream, const PaginatorRange<T>& pagination)
 {
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <iterator>
+#include "positional_index.h"
+
+namespace
+{
+	void AppendVarint(std::vector<uint8_t>& data, uint32_t value)
+	{
+		while(value >= 0x80)
+		{
+			data.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		data.push_back(static_cast<uint8_t>(value));
+	}
+
+	std::vector<uint32_t> DecodePositions(const uint8_t* begin, const uint8_t* end)
+	{
+		std::vector<uint32_t> positions;
+		uint32_t position = 0;
+
+		while(begin != end)
+		{
+			uint32_t delta = 0;
+			int shift = 0;
+
+			do
+			{
+				delta |= static_cast<uint32_t>(*begin & 0x7F) << shift;
+				shift += 7;
+			}
+			while((*begin++ & 0x80) != 0);
+
+			position += delta;
+			positions.push_back(position);
+		}
+
+		return positions;
+	}
+}
+
+void PositionalIndex::AddDocument(int document_id, std::vector<std::pair<std::string_view, uint32_t>> word_positions)
+{
+	RemoveDocument(document_id);
+
+	std::sort(word_positions.begin(), word_positions.end());
+
+	DocumentPositions document;
+	document.data.reserve(word_positions.size());
+
+	for(size_t i = 0; i < word_positions.size(); ++i)
+	{
+		const auto& [word, position] = word_positions[i];
+
+		if(i == 0 || word_positions[i - 1].first != word)
+		{
+			document.words.emplace_back(word, static_cast<uint32_t>(document.data.size()));
+			AppendVarint(document.data, position);
+		}
+		else
+		{
+			AppendVarint(document.data, position - word_positions[i - 1].second);
+		}
+	}
+
+	document.words.shrink_to_fit();
+	document.data.shrink_to_fit();
+
+	encoded_size_ += document.data.size();
+	documents_.emplace(document_id, std::move(document));
+}
+
+void PositionalIndex::RemoveDocument(int document_id)
+{
+	const auto it = documents_.find(document_id);
+
+	if(it == documents_.end())
+	{
+		return;
+	}
+
+	encoded_size_ -= it->second.data.size();
+	documents_.erase(it);
+}
+
+bool PositionalIndex::HasDocument(int document_id) const
+{
+	return documents_.count(document_id) != 0;
+}
+
+std::vector<uint32_t> PositionalIndex::GetPositions(int document_id, std::string_view word) const
+{
+	const auto document = documents_.find(document_id);
+
+	if(document == documents_.end())
+	{
+		return {};
+	}
+
+	const auto& words = document->second.words;
+	const auto& data = document->second.data;
+
+	const auto it = std::lower_bound(words.begin(), words.end(), word, [](const auto& entry, std::string_view value)
+	{
+		return entry.first < value;
+	});
+
+	if(it == words.end() || it->first != word)
+	{
+		return {};
+	}
+
+	const uint32_t end = std::next(it) == words.end() ? static_cast<uint32_t>(data.size()) : std::next(it)->second;
+
+	return DecodePositions(data.data() + it->second, data.data() + end);
+}
+
+bool PositionalIndex::ContainsPhrase(int document_id, const Phrase& phrase) const
+{
+	if(!HasDocument(document_id))
+	{
+		return false;
+	}
+
+	if(phrase.empty())
+	{
+		return true;
+	}
+
+	std::vector<std::vector<uint32_t>> positions;
+	positions.reserve(phrase.size());
+
+	for(const auto& term : phrase)
+	{
+		positions.push_back(GetPositions(document_id, term.word));
+
+		if(positions.back().empty())
+		{
+			return false;
+		}
+	}
+
+	// Every occurrence of the first term fixes where the phrase would start.
+	for(const uint32_t anchor : positions.front())
+	{
+		if(anchor < phrase.front().offset)
+		{
+			continue;
+		}
+
+		const uint32_t start = anchor - phrase.front().offset;
+
+		bool matched = true;
+
+		for(size_t i = 1; i < phrase.size() && matched; ++i)
+		{
+			matched = std::binary_search(positions[i].begin(), positions[i].end(), start + phrase[i].offset);
+		}
+
+		if(matched)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+size_t PositionalIndex::GetEncodedSize() const
+{
+	return encoded_size_;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct PhraseTerm
+{
+	std::string_view word;
+	// Distance from the start of the phrase; stop words keep their slot, so offsets may skip.
+	uint32_t offset;
+};
+
+using Phrase = std::vector<PhraseTerm>;
+
+// Word positions for the documents that opted into them. Every word of a document gets
+// a varint run of delta-encoded positions inside one byte buffer per document, so
+// documents indexed without positions have no entry at all.
+class PositionalIndex
+{
+public:
+	void AddDocument(int document_id, std::vector<std::pair<std::string_view, uint32_t>> word_positions);
+	void RemoveDocument(int document_id);
+
+	bool HasDocument(int document_id) const;
+
+	std::vector<uint32_t> GetPositions(int document_id, std::string_view word) const;
+
+	// False for documents without positions: a phrase can't be confirmed there.
+	bool ContainsPhrase(int document_id, const Phrase& phrase) const;
+
+	size_t GetEncodedSize() const;
+
+private:
+	struct DocumentPositions
+	{
+		// Sorted by word; the second member is where the word's run starts in data.
+		std::vector<std::pair<std::string_view, uint32_t>> words;
+		std::vector<uint8_t> data;
+	};
+
+	std::unordered_map<int, DocumentPositions> documents_;
+	size_t encoded_size_ = 0;
+};
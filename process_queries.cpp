@@ -1,28 +1,133 @@
-#include <execution>
+#include <algorithm>
+#include <stdexcept>
 #include "process_queries.h"
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries)
+{
+	return ProcessQueries(SearchThreadPool::Shared(), search_server, queries);
+}
+
+std::vector<std::vector<Document>> ProcessQueries(SearchThreadPool& pool, const SearchServer& search_server, const std::vector<std::string>& queries)
 {
 	std::vector<std::vector<Document>> result(queries.size());
 
-	transform(std::execution::par, queries.begin(), queries.end(), result.begin(), [&search_server](const auto& query)
+	pool.ParallelFor(queries.size(), [&](size_t i)
 	{
-		return search_server.FindTopDocuments(query);
+		result[i] = search_server.FindTopDocuments(queries[i]);
 	});
 
 	return result;
 }
 
-std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries)
+void ProcessQueriesStream(const SearchServer& search_server, const std::vector<std::string>& queries,
+						  const std::function<void(size_t query_index, std::vector<Document> documents)>& consumer)
 {
-	std::vector<std::vector<Document>> docs = ProcessQueries(search_server, queries);
+	ProcessQueriesStream(SearchThreadPool::Shared(), search_server, queries, consumer);
+}
 
-	std::list<Document> result;
+void ProcessQueriesStream(SearchThreadPool& pool, const SearchServer& search_server, const std::vector<std::string>& queries,
+						  const std::function<void(size_t query_index, std::vector<Document> documents)>& consumer)
+{
+	pool.ParallelFor(queries.size(), [&](size_t i)
+	{
+		consumer(i, search_server.FindTopDocuments(queries[i]));
+	});
+}
 
-	for (const auto& doc : docs)
+JoinedDocuments::JoinedDocuments(std::vector<Document> documents, std::vector<size_t> offsets)
+	: documents_(std::move(documents)), offsets_(std::move(offsets))
+{
+	if(offsets_.empty() || offsets_.front() != 0 || offsets_.back() != documents_.size() || !std::is_sorted(offsets_.begin(), offsets_.end()))
 	{
-		result.insert(result.end(), doc.begin(), doc.end());
+		throw std::invalid_argument("joined document offsets do not describe the document array");
 	}
+}
 
-	return result;
+JoinedDocuments::const_iterator JoinedDocuments::begin() const
+{
+	return documents_.begin();
+}
+
+JoinedDocuments::const_iterator JoinedDocuments::end() const
+{
+	return documents_.end();
+}
+
+size_t JoinedDocuments::size() const
+{
+	return documents_.size();
+}
+
+bool JoinedDocuments::empty() const
+{
+	return documents_.empty();
+}
+
+size_t JoinedDocuments::GetQueryCount() const
+{
+	return offsets_.size() - 1;
+}
+
+PaginatorRange<JoinedDocuments::const_iterator> JoinedDocuments::GetQueryDocuments(size_t query_index) const
+{
+	if(query_index >= GetQueryCount())
+	{
+		throw std::out_of_range("query index is out of range");
+	}
+
+	return {documents_.begin() + offsets_[query_index], documents_.begin() + offsets_[query_index + 1]};
+}
+
+JoinedDocuments ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries)
+{
+	return ProcessQueriesJoined(SearchThreadPool::Shared(), search_server, queries);
+}
+
+JoinedDocuments ProcessQueriesJoined(SearchThreadPool& pool, const SearchServer& search_server, const std::vector<std::string>& queries)
+{
+	return ProcessQueriesJoined(pool, search_server, queries, SearchOptions{});
+}
+
+JoinedDocuments ProcessQueriesJoined(SearchThreadPool& pool, const SearchServer& search_server, const std::vector<std::string>& queries, const SearchOptions& options)
+{
+	// Each task runs a contiguous run of queries into a buffer of its own, so the buffers hold
+	// only the documents actually found and come out in query order. A few runs per worker
+	// let idle workers steal from busy ones.
+	const size_t chunk_count = std::min(queries.size(), pool.GetThreadCount() * 4);
+	std::vector<std::vector<Document>> chunks(chunk_count);
+	std::vector<size_t> counts(queries.size());
+
+	pool.ParallelFor(chunk_count, [&](size_t chunk)
+	{
+		const size_t first = queries.size() * chunk / chunk_count;
+		const size_t last = queries.size() * (chunk + 1) / chunk_count;
+
+		for(size_t i = first; i < last; ++i)
+		{
+			counts[i] = search_server.AppendTopDocuments(std::execution::seq, queries[i],
+				[](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; }, options, chunks[chunk]);
+		}
+	});
+
+	std::vector<size_t> offsets(queries.size() + 1, 0);
+
+	for(size_t i = 0; i < queries.size(); ++i)
+	{
+		offsets[i + 1] = offsets[i] + counts[i];
+	}
+
+	if(chunk_count == 1)
+	{
+		return JoinedDocuments(std::move(chunks.front()), std::move(offsets));
+	}
+
+	std::vector<Document> documents;
+	documents.reserve(offsets.back());
+
+	for(const auto& chunk : chunks)
+	{
+		documents.insert(documents.end(), chunk.begin(), chunk.end());
+	}
+
+	return JoinedDocuments(std::move(documents), std::move(offsets));
 }
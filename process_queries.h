@@ -2,9 +2,47 @@
 
 #include <vector>
 #include <string>
-#include <list>
+#include <functional>
 #include "search_server.h"
+#include "paginator.h"
+#include "search_thread_pool.h"
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries);
+std::vector<std::vector<Document>> ProcessQueries(SearchThreadPool& pool, const SearchServer& search_server, const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+// Hands every result to consumer as soon as its query completes, in completion order.
+// consumer is called concurrently from the pool's workers.
+void ProcessQueriesStream(const SearchServer& search_server, const std::vector<std::string>& queries,
+						  const std::function<void(size_t query_index, std::vector<Document> documents)>& consumer);
+void ProcessQueriesStream(SearchThreadPool& pool, const SearchServer& search_server, const std::vector<std::string>& queries,
+						  const std::function<void(size_t query_index, std::vector<Document> documents)>& consumer);
+
+// Results of a query batch in one contiguous array; the documents of query i
+// occupy [offsets[i], offsets[i + 1]). Iterating visits every document in query order.
+class JoinedDocuments
+{
+public:
+	using const_iterator = std::vector<Document>::const_iterator;
+
+	JoinedDocuments() = default;
+	JoinedDocuments(std::vector<Document> documents, std::vector<size_t> offsets);
+
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	size_t size() const;
+	bool empty() const;
+
+	size_t GetQueryCount() const;
+	PaginatorRange<const_iterator> GetQueryDocuments(size_t query_index) const;
+
+private:
+	std::vector<Document> documents_;
+	std::vector<size_t> offsets_ = {0};
+};
+
+JoinedDocuments ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+JoinedDocuments ProcessQueriesJoined(SearchThreadPool& pool, const SearchServer& search_server, const std::vector<std::string>& queries);
+// Each query keeps at most options.limit documents (ACTUAL ones, like FindTopDocuments); the
+// array is sized by the documents found, not by the limit.
+JoinedDocuments ProcessQueriesJoined(SearchThreadPool& pool, const SearchServer& search_server, const std::vector<std::string>& queries, const SearchOptions& options);
@@ -0,0 +1,55 @@
+#include <sstream>
+#include "query_explanation.h"
+
+std::string QueryExplanation::ToText() const
+{
+	std::ostringstream stream;
+
+	const auto print_terms = [&stream](const char* label, const std::vector<Term>& terms)
+	{
+		for(const auto& term : terms)
+		{
+			stream << label << ' ' << term.word << " postings " << term.posting_length << " idf " << term.inverse_document_freq;
+
+			if(term.weight != 1)
+			{
+				stream << " weight " << term.weight;
+			}
+
+			stream << '\n';
+		}
+	};
+
+	print_terms("plus", plus_terms);
+	print_terms("minus", minus_terms);
+
+	for(const auto& word : stop_words)
+	{
+		stream << "stop " << word << '\n';
+	}
+
+	if(phrase_count != 0)
+	{
+		stream << "phrases " << phrase_count << '\n';
+	}
+
+	if(used_impact_index)
+	{
+		stream << "impact index candidates " << candidates_quantized << '\n';
+	}
+
+	stream << "postings touched " << postings_touched << '\n'
+		   << "candidates " << candidates_scored << '\n'
+		   << "rejected by predicate " << rejected_by_predicate << '\n'
+		   << "removed by minus " << removed_by_minus << '\n'
+		   << "removed by phrase " << removed_by_phrase << '\n'
+		   << "removed by cursor " << removed_by_cursor << '\n'
+		   << "results " << result_count << '\n';
+
+	for(const auto& [stage, duration] : stage_durations)
+	{
+		stream << "stage " << stage << ' ' << duration.count() << " ns\n";
+	}
+
+	return stream.str();
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// How a search ran: what the query parsed into, how many documents each stage kept and
+// how long each stage took.
+struct QueryExplanation
+{
+	struct Term
+	{
+		std::string word;
+		size_t posting_length = 0;
+		// As the ranking computes it; 0 for words no document contains.
+		double inverse_document_freq = 0;
+		// Below 1 for words that only came from fuzzy matching.
+		double weight = 1;
+	};
+
+	std::vector<Term> plus_terms;
+	std::vector<Term> minus_terms;
+	std::vector<std::string> stop_words;
+	size_t phrase_count = 0;
+
+	// The impact path scores candidates_quantized documents from quantized impacts and only
+	// the candidates_scored that can reach the top exactly. It drops minus-word documents
+	// while accumulating, so removed_by_minus stays 0 there.
+	bool used_impact_index = false;
+	size_t candidates_quantized = 0;
+
+	// Posting entries read, minus words included.
+	size_t postings_touched = 0;
+	size_t candidates_scored = 0;
+	size_t rejected_by_predicate = 0;
+	size_t removed_by_minus = 0;
+	size_t removed_by_phrase = 0;
+	size_t removed_by_cursor = 0;
+	size_t result_count = 0;
+
+	std::vector<std::pair<std::string, std::chrono::nanoseconds>> stage_durations;
+
+	std::string ToText() const;
+};
+
+// Collects a QueryExplanation along the search path. The search code is templated on the
+// trace type and calls these hooks; QueryTrace<false> has only empty inline members, so
+// ordinary searches compile to the same code as if the hooks were not there. Other traces
+// (SlowQueryLog::Trace) implement the same hooks.
+template<bool Enabled>
+class QueryTrace;
+
+template<>
+class QueryTrace<false>
+{
+public:
+	struct StageTimer
+	{
+		// User-provided, so an unused timer doesn't warn.
+		~StageTimer() {}
+	};
+
+	StageTimer Stage(const char*) { return {}; }
+
+	void OnPostings(size_t) {}
+	void OnPredicateRejected(int) {}
+	void OnCandidates(size_t) {}
+	void OnRemovedByMinus(size_t) {}
+	void OnRemovedByPhrase(size_t) {}
+	void OnRemovedByCursor(size_t) {}
+	void OnResults(size_t) {}
+	void OnImpactIndex(size_t) {}
+};
+
+template<>
+class QueryTrace<true>
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	class StageTimer
+	{
+	public:
+		StageTimer(QueryTrace& trace, const char* name) : trace_(trace), name_(name) {}
+
+		StageTimer(const StageTimer&) = delete;
+		StageTimer& operator=(const StageTimer&) = delete;
+
+		~StageTimer()
+		{
+			trace_.explanation_.stage_durations.emplace_back(name_, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_));
+		}
+
+	private:
+		QueryTrace& trace_;
+		const char* name_;
+		const Clock::time_point start_time_ = Clock::now();
+	};
+
+	StageTimer Stage(const char* name) { return StageTimer(*this, name); }
+
+	void OnPostings(size_t count) { postings_touched_.fetch_add(count, std::memory_order_relaxed); }
+
+	// Parallel searches call this from several threads; a document is counted once even
+	// when several of its terms reach the predicate.
+	void OnPredicateRejected(int document_id)
+	{
+		const std::lock_guard lock(mutex_);
+		rejected_ids_.insert(document_id);
+	}
+
+	void OnCandidates(size_t count) { explanation_.candidates_scored = count; }
+	void OnRemovedByMinus(size_t count) { explanation_.removed_by_minus += count; }
+	void OnRemovedByPhrase(size_t count) { explanation_.removed_by_phrase += count; }
+	void OnRemovedByCursor(size_t count) { explanation_.removed_by_cursor += count; }
+	void OnResults(size_t count) { explanation_.result_count = count; }
+
+	void OnImpactIndex(size_t candidates)
+	{
+		explanation_.used_impact_index = true;
+		explanation_.candidates_quantized = candidates;
+	}
+
+	QueryExplanation& GetExplanation() { return explanation_; }
+
+	QueryExplanation TakeExplanation()
+	{
+		explanation_.postings_touched = postings_touched_.load(std::memory_order_relaxed);
+		explanation_.rejected_by_predicate = rejected_ids_.size();
+		return std::move(explanation_);
+	}
+
+private:
+	QueryExplanation explanation_;
+	std::atomic<size_t> postings_touched_{0};
+	std::mutex mutex_;
+	std::unordered_set<int> rejected_ids_;
+};
@@ -0,0 +1,136 @@
+#include "query_service.h"
+
+QueryService::QueryService(const SearchServer& search_server, size_t queue_capacity, OverflowPolicy overflow_policy, size_t worker_count)
+	: search_server_(&search_server), queue_capacity_(queue_capacity), overflow_policy_(overflow_policy)
+{
+	if(queue_capacity == 0)
+	{
+		throw std::invalid_argument("query queue capacity must be positive");
+	}
+
+	worker_count = std::max<size_t>(worker_count, 1);
+	workers_.reserve(worker_count);
+
+	for(size_t i = 0; i < worker_count; ++i)
+	{
+		workers_.emplace_back([this] { WorkerLoop(); });
+	}
+}
+
+QueryService::~QueryService()
+{
+	std::deque<Request> abandoned;
+
+	{
+		const std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+		abandoned.swap(requests_);
+	}
+
+	not_empty_.notify_all();
+
+	for(auto& worker : workers_)
+	{
+		worker.join();
+	}
+
+	for(auto& request : abandoned)
+	{
+		request.promise.set_exception(std::make_exception_ptr(QueueOverflowError("query service stopped before the query ran")));
+	}
+}
+
+std::future<std::vector<Document>> QueryService::SubmitQuery(std::string raw_query, DocumentPredicate predicate)
+{
+	Request request{std::move(raw_query), std::move(predicate), {}};
+	std::future<std::vector<Document>> result = request.promise.get_future();
+
+	std::promise<std::vector<Document>> shed;
+	bool is_shed = false;
+
+	{
+		const std::lock_guard<std::mutex> lock(mutex_);
+
+		if(requests_.size() >= queue_capacity_)
+		{
+			if(overflow_policy_ == OverflowPolicy::REJECT)
+			{
+				rejected_count_.fetch_add(1, std::memory_order_relaxed);
+				request.promise.set_exception(std::make_exception_ptr(QueueOverflowError("query queue is full")));
+				return result;
+			}
+
+			shed = std::move(requests_.front().promise);
+			requests_.pop_front();
+			is_shed = true;
+		}
+
+		requests_.push_back(std::move(request));
+	}
+
+	not_empty_.notify_one();
+
+	if(is_shed)
+	{
+		shed_count_.fetch_add(1, std::memory_order_relaxed);
+		shed.set_exception(std::make_exception_ptr(QueueOverflowError("query was shed by a newer one")));
+	}
+
+	return result;
+}
+
+std::future<std::vector<Document>> QueryService::SubmitQuery(std::string raw_query, DocumentStatus document_status)
+{
+	return SubmitQuery(std::move(raw_query), [document_status](int, DocumentStatus status, int) { return status == document_status; });
+}
+
+std::future<std::vector<Document>> QueryService::SubmitQuery(std::string raw_query)
+{
+	return SubmitQuery(std::move(raw_query), DocumentStatus::ACTUAL);
+}
+
+size_t QueryService::GetQueueSize() const
+{
+	const std::lock_guard<std::mutex> lock(mutex_);
+	return requests_.size();
+}
+
+uint64_t QueryService::GetRejectedCount() const
+{
+	return rejected_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t QueryService::GetShedCount() const
+{
+	return shed_count_.load(std::memory_order_relaxed);
+}
+
+void QueryService::WorkerLoop()
+{
+	while(true)
+	{
+		Request request;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			not_empty_.wait(lock, [this] { return stopping_ || !requests_.empty(); });
+
+			if(requests_.empty())
+			{
+				return;
+			}
+
+			request = std::move(requests_.front());
+			requests_.pop_front();
+		}
+
+		try
+		{
+			request.promise.set_value(search_server_->FindTopDocuments(std::execution::seq, request.raw_query, request.predicate));
+		}
+		catch(...)
+		{
+			request.promise.set_exception(std::current_exception());
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "search_server.h"
+#include "search_thread_pool.h"
+
+enum class OverflowPolicy
+{
+	REJECT,
+	SHED_OLDEST,
+};
+
+class QueueOverflowError : public std::runtime_error
+{
+public:
+	using std::runtime_error::runtime_error;
+};
+
+// Asynchronous front door for a SearchServer: queries go through a bounded MPMC queue to a set of
+// worker threads. A full queue either rejects the new query or sheds the oldest waiting one; the
+// affected future then holds a QueueOverflowError, so latency stays bounded during bursts.
+class QueryService
+{
+public:
+	using DocumentPredicate = std::function<bool(int, DocumentStatus, int)>;
+
+	QueryService(const SearchServer& search_server, size_t queue_capacity, OverflowPolicy overflow_policy = OverflowPolicy::REJECT,
+				 size_t worker_count = SearchThreadPool::DefaultThreadCount());
+	~QueryService();
+
+	QueryService(const QueryService&) = delete;
+	QueryService& operator=(const QueryService&) = delete;
+
+	std::future<std::vector<Document>> SubmitQuery(std::string raw_query, DocumentPredicate predicate);
+	std::future<std::vector<Document>> SubmitQuery(std::string raw_query, DocumentStatus document_status);
+	std::future<std::vector<Document>> SubmitQuery(std::string raw_query);
+
+	size_t GetQueueSize() const;
+	uint64_t GetRejectedCount() const;
+	uint64_t GetShedCount() const;
+
+private:
+	struct Request
+	{
+		std::string raw_query;
+		DocumentPredicate predicate;
+		std::promise<std::vector<Document>> promise;
+	};
+
+	const SearchServer* search_server_;
+	const size_t queue_capacity_;
+	const OverflowPolicy overflow_policy_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable not_empty_;
+	std::deque<Request> requests_;
+	bool stopping_ = false;
+
+	std::atomic<uint64_t> rejected_count_{0};
+	std::atomic<uint64_t> shed_count_{0};
+
+	std::vector<std::thread> workers_;
+
+	void WorkerLoop();
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include "document.h"
+
+struct CorpusStatistics
+{
+	size_t document_count = 0;
+	double average_document_length = 0;
+};
+
+// A ranking is any type with PrepareTerm(corpus, document_freq) returning a term scorer:
+// a callable (term_freq, document) -> relevance contribution, where term_freq is the
+// share of the document's words equal to the term. Rankings are template arguments of
+// FindTopDocuments, so the scorer is inlined into the posting loop: per-term constants
+// are computed once in PrepareTerm and the loop itself has no calls or branches.
+struct TfIdfRanking
+{
+	struct TermScorer
+	{
+		double inverse_document_freq;
+
+		double operator()(double term_freq, const DocumentData&) const
+		{
+			return term_freq * inverse_document_freq;
+		}
+	};
+
+	TermScorer PrepareTerm(const CorpusStatistics& corpus, size_t document_freq) const
+	{
+		return {std::log(corpus.document_count * 1.0 / document_freq)};
+	}
+};
+
+struct Bm25Ranking
+{
+	double k1 = 1.2;
+	double b = 0.75;
+
+	struct TermScorer
+	{
+		double inverse_document_freq;
+		double k1;
+		// k1 * (1 - b + b * length / average_length) == length_base + length_scale * length
+		double length_base;
+		double length_scale;
+
+		double operator()(double term_freq, const DocumentData& document) const
+		{
+			const double length = static_cast<double>(document.length);
+			const double count = term_freq * length;
+			return inverse_document_freq * count * (k1 + 1) / (count + length_base + length_scale * length);
+		}
+	};
+
+	TermScorer PrepareTerm(const CorpusStatistics& corpus, size_t document_freq) const
+	{
+		const double document_count = static_cast<double>(corpus.document_count);
+		const double inverse_document_freq = std::log(1 + (document_count - document_freq + 0.5) / (document_freq + 0.5));
+		const double average_length = corpus.average_document_length > 0 ? corpus.average_document_length : 1;
+
+		return {inverse_document_freq, k1, k1 * (1 - b), k1 * b / average_length};
+	}
+};
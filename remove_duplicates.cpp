@@ -9,6 +9,7 @@ void RemoveDuplicates(SearchServer& search_server)
 	for(auto id : duplicated_ids)
 	{
 		std::cout << "Found duplicate document id " << id << std::endl;
-		search_server.RemoveDocument(id);
 	}
+
+	search_server.RemoveDocuments(std::execution::par, std::vector<int>(duplicated_ids.begin(), duplicated_ids.end()));
 }
@@ -1,13 +1,162 @@
+#include <algorithm>
+#include <stdexcept>
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server) : search_server_(&search_server) {}
+std::chrono::microseconds RequestQueue::WindowStatistics::GetMeanLatency() const
+{
+	return total_requests == 0 ? std::chrono::microseconds{0} : total_latency / static_cast<int64_t>(total_requests);
+}
+
+RequestQueue::RequestQueue(const SearchServer& search_server, Clock::duration window)
+	: start_(Clock::now()), bucket_width_(std::max<Clock::duration>(window / BUCKET_COUNT, Clock::duration(1))), search_server_(&search_server)
+{
+	if(window <= Clock::duration::zero())
+	{
+		throw std::invalid_argument("request statistics window must be positive");
+	}
+}
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus document_status)
 {
-	return AddFindRequest(raw_query, [document_status](int, DocumentStatus status, int) { return status == document_status; });
+	static constexpr std::array<std::string_view, 4> STATUS_FILTERS = {"status=ACTUAL", "status=IRRELEVANT", "status=BANNED", "status=REMOVED"};
+
+	return AddFindRequest(raw_query, [document_status](int, DocumentStatus status, int) { return status == document_status; }, STATUS_FILTERS.at(static_cast<size_t>(document_status)));
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query)
 {
 	return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
+
+void RequestQueue::RecordRequest(size_t result_count, Clock::duration latency, Clock::time_point now)
+{
+	const uint64_t epoch = GetEpoch(now);
+	Bucket& bucket = buckets_[epoch % BUCKET_COUNT];
+	const uint64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+
+	AddToCounter(bucket.total_requests, epoch, 1);
+	AddToCounter(bucket.no_result_requests, epoch, result_count == 0 ? 1 : 0);
+	AddToCounter(bucket.total_latency_us, epoch, latency_us);
+	MaxToCounter(bucket.max_latency_us, epoch, latency_us);
+}
+
+void RequestQueue::SetSlowQueryLog(SlowQueryLog* slow_query_log)
+{
+	slow_query_log_ = slow_query_log;
+}
+
+int RequestQueue::GetNoResultRequests() const
+{
+	return static_cast<int>(GetStatistics().no_result_requests);
+}
+
+RequestQueue::WindowStatistics RequestQueue::GetStatistics(Clock::time_point now) const
+{
+	const uint64_t current_epoch = GetEpoch(now);
+	WindowStatistics result;
+
+	for(size_t slot = 0; slot < BUCKET_COUNT; ++slot)
+	{
+		// The only epoch of the current window that maps onto this slot.
+		const uint64_t distance = (current_epoch + BUCKET_COUNT - slot) % BUCKET_COUNT;
+
+		if(distance > current_epoch)
+		{
+			continue;
+		}
+
+		const uint64_t epoch = current_epoch - distance;
+		const Bucket& bucket = buckets_[slot];
+
+		result.total_requests += ReadCounter(bucket.total_requests, epoch);
+		result.no_result_requests += ReadCounter(bucket.no_result_requests, epoch);
+		result.total_latency += std::chrono::microseconds(ReadCounter(bucket.total_latency_us, epoch));
+		result.max_latency = std::max(result.max_latency, std::chrono::microseconds(ReadCounter(bucket.max_latency_us, epoch)));
+	}
+
+	return result;
+}
+
+uint64_t RequestQueue::GetEpoch(Clock::time_point now) const
+{
+	return now <= start_ ? 0 : static_cast<uint64_t>((now - start_) / bucket_width_);
+}
+
+void RequestQueue::AddToCounter(std::atomic<uint64_t>& counter, uint64_t epoch, uint64_t value)
+{
+	const uint64_t tag = (epoch & ((uint64_t(1) << EPOCH_BITS) - 1)) << VALUE_BITS;
+	const uint64_t value_mask = (uint64_t(1) << VALUE_BITS) - 1;
+	uint64_t current = counter.load(std::memory_order_relaxed);
+
+	while(true)
+	{
+		const int64_t age = GetEpochAge(current, epoch);
+
+		// A late write for an epoch the bucket has already moved past.
+		if(age < 0)
+		{
+			return;
+		}
+
+		const uint64_t base = age == 0 ? current & value_mask : 0;
+		const uint64_t desired = tag | ((base + value) & value_mask);
+
+		if(desired == current || counter.compare_exchange_weak(current, desired, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+}
+
+void RequestQueue::MaxToCounter(std::atomic<uint64_t>& counter, uint64_t epoch, uint64_t value)
+{
+	const uint64_t tag = (epoch & ((uint64_t(1) << EPOCH_BITS) - 1)) << VALUE_BITS;
+	const uint64_t value_mask = (uint64_t(1) << VALUE_BITS) - 1;
+	uint64_t current = counter.load(std::memory_order_relaxed);
+
+	while(true)
+	{
+		const int64_t age = GetEpochAge(current, epoch);
+
+		if(age < 0)
+		{
+			return;
+		}
+
+		const uint64_t base = age == 0 ? current & value_mask : 0;
+		const uint64_t desired = tag | std::min(std::max(base, value), value_mask);
+
+		if(desired == current || counter.compare_exchange_weak(current, desired, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+}
+
+int64_t RequestQueue::GetEpochAge(uint64_t counter_value, uint64_t epoch)
+{
+	const uint64_t epoch_mask = (uint64_t(1) << EPOCH_BITS) - 1;
+	const uint64_t value_mask = (uint64_t(1) << VALUE_BITS) - 1;
+
+	// An empty counter holds no counts to lose, whatever epoch it is tagged with.
+	if((counter_value & value_mask) == 0)
+	{
+		return 1;
+	}
+
+	// Tags wrap around, so the distance is taken modulo the tag range: within its lower
+	// half the write is newer, within the upper half older.
+	const uint64_t distance = (epoch - (counter_value >> VALUE_BITS)) & epoch_mask;
+	const uint64_t half_range = uint64_t(1) << (EPOCH_BITS - 1);
+
+	return distance < half_range ? static_cast<int64_t>(distance) : static_cast<int64_t>(distance) - static_cast<int64_t>(epoch_mask + 1);
+}
+
+uint64_t RequestQueue::ReadCounter(const std::atomic<uint64_t>& counter, uint64_t epoch)
+{
+	const uint64_t tag = (epoch & ((uint64_t(1) << EPOCH_BITS) - 1)) << VALUE_BITS;
+	const uint64_t value_mask = (uint64_t(1) << VALUE_BITS) - 1;
+	const uint64_t current = counter.load(std::memory_order_relaxed);
+
+	return (current & ~value_mask) == tag ? current & value_mask : 0;
+}
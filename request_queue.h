@@ -1,15 +1,36 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <vector>
-#include <deque>
 #include <string>
 #include "search_server.h"
+#include "slow_query_log.h"
 
 struct Document;
 
+// Records search requests from any number of threads into a lock-free ring of time buckets and
+// reports statistics over a sliding time window. The window advances one bucket
+// (window / BUCKET_COUNT) at a time.
 class RequestQueue {
 public:
-	explicit RequestQueue(const SearchServer& search_server);
+	using Clock = std::chrono::steady_clock;
+
+	struct WindowStatistics
+	{
+		uint64_t total_requests = 0;
+		uint64_t no_result_requests = 0;
+		std::chrono::microseconds total_latency{0};
+		std::chrono::microseconds max_latency{0};
+
+		std::chrono::microseconds GetMeanLatency() const;
+	};
+
+	inline static constexpr size_t BUCKET_COUNT = 64;
+
+	explicit RequestQueue(const SearchServer& search_server, Clock::duration window = std::chrono::hours(24));
 
 	template <typename DocumentPredicate>
 	std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
@@ -18,52 +39,78 @@ public:
 
 	std::vector<Document> AddFindRequest(const std::string& raw_query);
 
-	inline int GetNoResultRequests() const
-	{
-		return requests_.size() - requests_.back().query_count;
-	}
+	void RecordRequest(size_t result_count, Clock::duration latency, Clock::time_point now = Clock::now());
+
+	// Requests also go to slow_query_log (not owned), with stage timings; nullptr turns it off.
+	void SetSlowQueryLog(SlowQueryLog* slow_query_log);
+
+	int GetNoResultRequests() const;
+
+	WindowStatistics GetStatistics(Clock::time_point now = Clock::now()) const;
+
 private:
-	struct QueryResult
+	// Each counter packs the epoch it belongs to into its top bits, so a bucket is
+	// recycled for a new epoch with a single CAS and no counts are lost to a reset race.
+	// Only a newer epoch recycles it; a write for an older one is dropped.
+	struct Bucket
 	{
-		int query_count;
+		std::atomic<uint64_t> total_requests{0};
+		std::atomic<uint64_t> no_result_requests{0};
+		std::atomic<uint64_t> total_latency_us{0};
+		std::atomic<uint64_t> max_latency_us{0};
 	};
 
-	std::deque<QueryResult> requests_;
-	const static int min_in_day_ = 1440;
+	inline static constexpr int EPOCH_BITS = 24;
+	inline static constexpr int VALUE_BITS = 64 - EPOCH_BITS;
+
+	std::array<Bucket, BUCKET_COUNT> buckets_;
+	const Clock::time_point start_;
+	const Clock::duration bucket_width_;
 
 	const SearchServer* search_server_;
+	SlowQueryLog* slow_query_log_ = nullptr;
+
+	template <typename DocumentPredicate>
+	std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate, std::string_view filter);
+
+	uint64_t GetEpoch(Clock::time_point now) const;
+
+	static void AddToCounter(std::atomic<uint64_t>& counter, uint64_t epoch, uint64_t value);
+	static void MaxToCounter(std::atomic<uint64_t>& counter, uint64_t epoch, uint64_t value);
+	static uint64_t ReadCounter(const std::atomic<uint64_t>& counter, uint64_t epoch);
+	// Epochs from the one counter_value holds to epoch: 0 for the same, negative when epoch is older.
+	static int64_t GetEpochAge(uint64_t counter_value, uint64_t epoch);
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate)
 {
-	std::vector<Document> result = search_server_->FindTopDocuments(raw_query, document_predicate);
+	return AddFindRequest(raw_query, document_predicate, "predicate");
+}
 
-	QueryResult query_result;
+template <typename DocumentPredicate>
+std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate, std::string_view filter)
+{
+	const Clock::time_point start = Clock::now();
+	std::vector<Document> result;
+	SlowQueryLog::Trace trace;
 
-	if(requests_.empty())
+	if (slow_query_log_ == nullptr)
 	{
-		query_result = {0};
+		result = search_server_->FindTopDocuments(raw_query, document_predicate);
 	}
 	else
 	{
-		query_result = requests_.back();
+		result = search_server_->FindTopDocuments(std::execution::seq, raw_query, document_predicate, SearchOptions{}, TfIdfRanking{}, trace);
 	}
 
-	if(result.empty())
-	{
-		requests_.push_back(query_result);
-	}
-	else
-	{
-		requests_.push_back({query_result.query_count + 1});
-	}
+	const Clock::time_point finish = Clock::now();
+	RecordRequest(result.size(), finish - start, finish);
 
-	if(requests_.size() > min_in_day_)
+	if (slow_query_log_ != nullptr && slow_query_log_->ShouldRecord(finish - start))
 	{
-		requests_.pop_front();
+		slow_query_log_->Record(raw_query, filter, result.size(), finish - start, trace);
 	}
 
 	return result;
-
 }
@@ -1,17 +1,39 @@
 #include <cmath>
+#include <cctype>
+#include <tuple>
 #include <iostream>
 #include <array>
 #include <string_view>
 #include <deque>
+#include <unordered_map>
+#include <memory_resource>
+#include <cstddef>
+#include <chrono>
+#include <limits>
 #include "log_duration.h"
 #include "search_server.h"
 #include "string_processing.h"
+#include "document_fingerprint.h"
 
 SearchServer::SearchServer(const std::string& words)
 {
 	SetStopWords(words);
 }
 
+SearchServer::~SearchServer()
+{
+	if(memory_ == nullptr)
+	{
+		return;
+	}
+
+	// The arena frees every node at once right after the members below are destroyed.
+	for(auto* resource : {&memory_->term_dictionary, &memory_->postings, &memory_->documents, &memory_->document_ids, &memory_->stop_words})
+	{
+		resource->DiscardDeallocations();
+	}
+}
+
 void SearchServer::SetStopWords(const std::string_view words)
 {
 	using namespace std::string_literals;
@@ -25,302 +47,1556 @@ void SearchServer::SetStopWords(const std::string_view words)
 			throw std::invalid_argument("word {"s + std::string(word) + "} contains illegal characters"s);
 		}
 
-		stop_words_.insert(std::string(word));
+		stop_words_.emplace(word);
 	}
 }
 
-std::string_view SearchServer::AddUniqueWord(const std::string& word)
+std::string_view SearchServer::AddUniqueWord(const std::string_view word)
 {
-	return std::string_view(*(unique_words.insert(word).first));
+	return terms_.Intern(word);
 }
 
-void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings)
+void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings, bool index_positions)
 {
 	CheckIsValidDocument(document_id);
+	AddPreparedDocument(PrepareDocument(document_id, document, status, ratings, index_positions));
+}
 
-	const std::string doc = std::string(document);
-
-	const auto words = SplitIntoWordsNoStop(doc);
+SearchServer::PreparedDocument SearchServer::PrepareDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings, bool index_positions) const
+{
+	std::deque<std::string_view> words;
 
-	const double inv_word_count = 1.0 / words.size();
+	{
+		RECORD_DURATION("ingest.tokenize");
+		words = SplitIntoWordsNoStop(document);
+	}
 
-	std::unordered_set<std::string_view> document_words_ids;
+	PreparedDocument prepared;
+	prepared.id = document_id;
+	prepared.status = status;
+	prepared.rating = ComputeAverageRating(ratings);
+	prepared.length = words.size();
+	prepared.index_positions = index_positions;
 
-	for (const auto word : words)
 	{
-		std::string_view current_word = AddUniqueWord(std::string(word));
+		// Counting scratch lives in a stack buffer and spills to the heap only for long documents.
+		std::array<std::byte, 16 * 1024> scratch_buffer;
+		std::pmr::monotonic_buffer_resource scratch(scratch_buffer.data(), scratch_buffer.size());
+		std::pmr::unordered_map<std::string_view, uint32_t> counts(words.size(), &scratch);
+
+		for (const auto word : words)
+		{
+			++counts[word];
+		}
 
-		word_to_document_freqs_[current_word][document_id] += inv_word_count;
-		document_words_ids.insert(current_word);
+		prepared.word_counts.assign(counts.begin(), counts.end());
 	}
 
-	documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, document_words_ids });
-	document_ids_.emplace(document_id);
-}
+	if(index_positions)
+	{
+		// Positions count stop words too, so "pet" in "funny and pet" is two words after "funny".
+		uint32_t position = 0;
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus doc_status) const
-{
-	return FindTopDocuments(std::execution::seq, raw_query, [doc_status](int document_id, DocumentStatus status, int rating) { return status == doc_status; });
-}
+		for(const auto word : SplitIntoWords(document))
+		{
+			if(!IsStopWord(word))
+			{
+				prepared.word_positions.emplace_back(word, position);
+			}
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const
-{
-	return FindTopDocuments(std::execution::seq, raw_query, [](int document_id, DocumentStatus status, int rating) { return status == DocumentStatus::ACTUAL; });
-}
+			++position;
+		}
+	}
 
-int SearchServer::GetDocumentCount() const
-{
-	return documents_.size();
+	return prepared;
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const
+void SearchServer::AddPreparedDocument(const PreparedDocument& document)
 {
-	return MatchDocument(std::execution::seq, raw_query, document_id);
-}
+	const DocumentFingerprint fingerprint = CheckPreparedDocument(document);
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy policy, const std::string_view raw_query, int document_id) const
-{
-	const Query query = ParseQuery(raw_query);
-	std::vector<std::string_view> matched_words;
+	std::array<std::byte, 4 * 1024> scratch_buffer;
+	std::pmr::monotonic_buffer_resource scratch(scratch_buffer.data(), scratch_buffer.size());
+	std::pmr::vector<std::pmr::map<int, double>*> word_postings(&scratch);
+	std::pmr::unordered_set<std::string_view> document_words_ids(document.word_counts.size(), &memory_->documents);
 
-	for (const auto word : documents_.at(document_id).words)
 	{
-		if (word_to_document_freqs_.count(word) == 0)
-		{
-			continue;
-		}
+		RECORD_DURATION("ingest.intern");
 
-		if (std::count(query.plus_words.begin(), query.plus_words.end(), word) != 0)
+		// Each distinct word is looked up once, not once per occurrence; known words come
+		// straight from the hash table with their postings, new ones are interned.
+		word_postings.reserve(document.word_counts.size());
+
+		for (const auto& [word, count] : document.word_counts)
 		{
-			matched_words.push_back(word.data());
+			const TermSlot slot = GetTermSlot(word);
+			word_postings.push_back(slot.postings);
+			document_words_ids.insert(slot.word);
 		}
 	}
 
-	for (const auto word : query.minus_words)
+	RECORD_DURATION("ingest.index");
+
+	for (size_t i = 0; i < word_postings.size(); ++i)
 	{
-		if (std::count(documents_.at(document_id).words.begin(), documents_.at(document_id).words.end(), word) != 0)
-		{
-			matched_words.clear();
-			break;
-		}
+		auto& postings = *word_postings[i];
+		// Ids usually grow, so the end of the posting list is the likely insert position.
+		postings.emplace_hint(postings.end(), document.id, ComputeTermFrequency(document.word_counts[i].second, document.length));
 	}
-    
-	return {matched_words, documents_.at(document_id).status};
-}
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy policy, const std::string_view raw_query, int document_id) const
-{
-	Query query(ParseQuery(raw_query));
+	std::vector<std::pair<std::string_view, uint32_t>> word_positions;
 
-	std::vector<std::string_view> matched_words(documents_.at(document_id).words.size());
-	
-	for(const auto w : documents_.at(document_id).words)
+	if(document.index_positions)
 	{
-		if(std::find(query.minus_words.begin(), query.minus_words.end(), w) != query.minus_words.end())
+		word_positions.reserve(document.word_positions.size());
+
+		for(const auto& [word, position] : document.word_positions)
 		{
-			return {{}, documents_.at(document_id).status};
+			word_positions.emplace_back(AddUniqueWord(word), position);
 		}
 	}
 
-	std::transform(policy, documents_.at(document_id).words.begin(), documents_.at(document_id).words.end(), matched_words.begin(), [&](auto word)
-	{
-		return (std::find(query.plus_words.begin(), query.plus_words.end(), word) != query.plus_words.end() ? word : std::string_view(""));
-	});
+	RegisterDocument(document, std::move(document_words_ids), std::move(word_positions), fingerprint);
+}
 
-	std::sort(matched_words.begin(), matched_words.end()); 
-	matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
+SearchServer::TermSlot SearchServer::GetTermSlot(const std::string_view word)
+{
+	auto known = word_postings_.find(word);
 
-	if(!matched_words.empty() && matched_words[0] == "")
+	if (known == word_postings_.end())
 	{
-		matched_words.erase(matched_words.begin());
+		const std::string_view interned = AddUniqueWord(word);
+		known = word_postings_.emplace(interned, &word_to_document_freqs_[interned]).first;
 	}
 
-	return {matched_words, documents_.at(document_id).status};
+	return {known->first, known->second};
 }
 
-std::set<int>::iterator SearchServer::begin() const
+std::vector<int> SearchServer::AddPreparedDocuments(const std::vector<PreparedDocument>& documents, std::vector<TermPostings>& postings)
 {
-	return document_ids_.begin();
+	return AddPreparedDocuments(std::execution::seq, documents, postings);
 }
 
-std::set<int>::iterator SearchServer::end() const
+std::vector<int> SearchServer::AddPreparedDocuments(std::execution::parallel_policy policy, const std::vector<PreparedDocument>& documents, std::vector<TermPostings>& postings)
 {
-	return document_ids_.end();
+	return AddPreparedDocumentsImpl(policy, documents, postings);
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
+std::vector<int> SearchServer::AddPreparedDocuments(std::execution::sequenced_policy policy, const std::vector<PreparedDocument>& documents, std::vector<TermPostings>& postings)
 {
-	static std::map<std::string_view, double> result;
+	return AddPreparedDocumentsImpl(policy, documents, postings);
+}
 
-	for(auto& [str, freq_map] : word_to_document_freqs_)
+template<typename Policy>
+std::vector<int> SearchServer::AddPreparedDocumentsImpl(Policy policy, const std::vector<PreparedDocument>& documents, std::vector<TermPostings>& postings)
+{
+	std::vector<int> rejected_ids;
+
+	for(const auto& document : documents)
 	{
-		auto it = freq_map.find(document_id);
+		try
+		{
+			const DocumentFingerprint fingerprint = CheckPreparedDocument(document);
+			std::pmr::unordered_set<std::string_view> words(document.word_counts.size(), &memory_->documents);
 
-		if(it != freq_map.end())
+			for(const auto& [word, count] : document.word_counts)
+			{
+				words.insert(word);
+			}
+
+			RegisterDocument(document, std::move(words), document.index_positions ? document.word_positions : std::vector<std::pair<std::string_view, uint32_t>>{}, fingerprint);
+		}
+		catch(const std::invalid_argument&)
 		{
-			result[str] = it->second;
+			rejected_ids.push_back(document.id);
 		}
 	}
 
-	return result;
-}
-
-void SearchServer::RemoveDocument(int document_id)
-{    
-  RemoveDocument(std::execution::seq, document_id);
-}
+	std::sort(rejected_ids.begin(), rejected_ids.end());
 
-void SearchServer::RemoveDocument(std::execution::sequenced_policy policy, int document_id)
-{
-	std::vector<std::string_view> words_ids(documents_[document_id].words.begin(), documents_[document_id].words.end());
+	RECORD_DURATION("ingest.index");
 
-	std::for_each(policy, words_ids.begin(), words_ids.end(), [document_id, this](std::string_view word)
+	// Each posting list is extended by one task only, and the synchronized pool hands nodes
+	// to any thread, so different terms merge in parallel.
+	std::for_each(policy, postings.begin(), postings.end(), [&rejected_ids](TermPostings& term)
 	{
-		word_to_document_freqs_.at(word).erase(document_id);
+		// A document adds one pair to a term, so this sorts by id.
+		std::sort(term.postings.begin(), term.postings.end());
+		auto& postings = *term.slot.postings;
+
+		for(const auto& [document_id, term_freq] : term.postings)
+		{
+			if(rejected_ids.empty() || !std::binary_search(rejected_ids.begin(), rejected_ids.end(), document_id))
+			{
+				postings.emplace_hint(postings.end(), document_id, term_freq);
+			}
+		}
 	});
 
-	document_ids_.erase(document_id);
-	documents_.erase(document_id);
+	return rejected_ids;
 }
 
-void SearchServer::RemoveDocument(std::execution::parallel_policy policy, int document_id)
+double SearchServer::ComputeTermFrequency(uint32_t count, size_t document_length)
 {
-	std::vector<std::string_view> words_ids(documents_[document_id].words.begin(), documents_[document_id].words.end());
+	const double inv_word_count = 1.0 / document_length;
+	// Repeated addition, as before counting, keeps term frequencies bit-for-bit the same.
+	double term_freq = 0;
 
-	std::for_each(policy, words_ids.begin(), words_ids.end(), [document_id, this](std::string_view word)
+	for (uint32_t i = 0; i < count; ++i)
 	{
-		word_to_document_freqs_[word].erase(document_id);
-	});
+		term_freq += inv_word_count;
+	}
 
-	document_ids_.erase(document_id);
-	documents_.erase(document_id);
+	return term_freq;
 }
 
-std::set<int> SearchServer::GetDuplicatedIds() const
+DocumentFingerprint SearchServer::CheckPreparedDocument(const PreparedDocument& document)
 {
-	std::set<int> result;
-	std::set<std::set<std::string_view>> unique_ids;
+	using namespace std::string_literals;
+
+	const int document_id = document.id;
+	CheckIsValidDocument(document_id);
 
-	auto current = std::begin(documents_);
-	const auto last = std::end(documents_);
+	DocumentFingerprint fingerprint;
 
-	while(current != last)
+	if(duplicate_handling_ != DuplicateHandling::IGNORE)
 	{
-		auto&& [key, value] = *current;
+		std::pmr::unordered_set<std::string_view> unique_document_words;
 
-		if(unique_ids.count(std::set<std::string_view>(value.words.begin(), value.words.end())) == 0)
+		for(const auto& [word, count] : document.word_counts)
 		{
-			unique_ids.emplace(value.words.begin(), value.words.end());
+			unique_document_words.insert(word);
 		}
-		else
+
+		fingerprint = ComputeDocumentFingerprint(unique_document_words);
+
+		if(duplicate_handling_ == DuplicateHandling::REJECT)
 		{
-			result.emplace(key);
+			if(const auto* group = FindDuplicateGroup(fingerprint, unique_document_words))
+			{
+				throw std::invalid_argument("document { id = "s + std::to_string(document_id) + " } duplicates document { id = "s + std::to_string(*group->begin()) + " }"s);
+			}
 		}
-		current++;
 	}
 
-	return result;
+	return fingerprint;
 }
 
-bool SearchServer::IsStopWord(const std::string_view word) const
+void SearchServer::RegisterDocument(const PreparedDocument& document, std::pmr::unordered_set<std::string_view> words,
+									std::vector<std::pair<std::string_view, uint32_t>> word_positions, const DocumentFingerprint& fingerprint)
 {
-	return stop_words_.find(word) != stop_words_.end();
+	const int document_id = document.id;
+
+	InvalidateImpactIndex();
+	documents_.emplace(document_id, DocumentData{ document.rating, document.status, std::move(words), document.length });
+	total_document_length_ += document.length;
+	document_ids_.emplace(document_id);
+
+	if(document.index_positions)
+	{
+		positional_index_.AddDocument(document_id, std::move(word_positions));
+	}
+
+	if(duplicate_handling_ != DuplicateHandling::IGNORE)
+	{
+		RegisterFingerprint(document_id, fingerprint, documents_.at(document_id).words);
+	}
 }
 
-std::deque<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const
+void SearchServer::SetDuplicateHandling(DuplicateHandling handling)
+{
+	const bool was_tracking = duplicate_handling_ != DuplicateHandling::IGNORE;
+	duplicate_handling_ = handling;
+
+	if(handling == DuplicateHandling::IGNORE)
+	{
+		fingerprint_to_ids_.clear();
+		duplicate_ids_.clear();
+	}
+	else if(!was_tracking)
+	{
+		for(const auto& [document_id, data] : documents_)
+		{
+			RegisterFingerprint(document_id, ComputeDocumentFingerprint(data.words), data.words);
+		}
+	}
+}
+
+void SearchServer::SetFuzzyPenalty(double penalty)
 {
 	using namespace std::string_literals;
 
-	std::vector<std::string_view> in_words(SplitIntoWords(text));
-	std::deque<std::string_view> words(in_words.size());
+	if(!(penalty >= 0.0 && penalty < 1.0))
+	{
+		throw std::invalid_argument("fuzzy penalty must be in [0, 1)"s);
+	}
 
-	for (const auto word : in_words)
+	fuzzy_penalty_ = penalty;
+}
+
+std::set<int>* SearchServer::FindDuplicateGroup(const DocumentFingerprint& fingerprint, const std::pmr::unordered_set<std::string_view>& words)
+{
+	auto it = fingerprint_to_ids_.find(fingerprint);
+
+	if(it == fingerprint_to_ids_.end())
 	{
-		if(!IsValidWord(word))
+		return nullptr;
+	}
+
+	for(auto& group : it->second)
+	{
+		if(documents_.at(*group.begin()).words == words)
 		{
-			throw std::invalid_argument("word {"s + std::string(word) + "} contains illegal characters"s);
+			return &group;
 		}
 	}
-  
-	std::transform(in_words.begin(), in_words.end(), words.begin(), [this](auto word)
-	{
-		return !IsStopWord(std::string(word)) ? word : std::string_view("");
-	});
 
-	words.erase(std::remove_if(words.begin(), words.end(), [](auto word) { return word.empty();	}), words.end());
-	
-	return words;
+	return nullptr;
 }
 
-int SearchServer::ComputeAverageRating(const std::vector<int>& ratings)
+void SearchServer::RegisterFingerprint(int document_id, const DocumentFingerprint& fingerprint, const std::pmr::unordered_set<std::string_view>& words)
 {
-	if (ratings.empty())
+	std::set<int>* group = FindDuplicateGroup(fingerprint, words);
+
+	if(group == nullptr)
 	{
-		return 0;
+		fingerprint_to_ids_[fingerprint].push_back({document_id});
+		return;
 	}
 
-	int rating_sum = accumulate(ratings.begin(), ratings.end(), 0);
-	return rating_sum / static_cast<int>(ratings.size());
+	// The lowest id in a group is the original, so a late arrival with a smaller id demotes the previous one.
+	const int previous_original = *group->begin();
+	group->insert(document_id);
+
+	if(document_id < previous_original)
+	{
+		duplicate_ids_.insert(previous_original);
+	}
+	else
+	{
+		duplicate_ids_.insert(document_id);
+	}
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const
+void SearchServer::UnregisterFingerprint(int document_id)
 {
-	using namespace std::string_literals;
+	const auto document = documents_.find(document_id);
 
-	if(!IsValidWord(text))
+	if(document == documents_.end())
 	{
-		throw std::invalid_argument("word contains illegal characters"s);
+		return;
 	}
 
-	if (text[0] == '-')
+	const auto it = fingerprint_to_ids_.find(ComputeDocumentFingerprint(document->second.words));
+
+	if(it == fingerprint_to_ids_.end())
+	{
+		return;
+	}
+
+	auto& groups = it->second;
+
+	for(auto group = groups.begin(); group != groups.end(); ++group)
 	{
-		return {text.substr(1), true, IsStopWord(text.data())};
+		if(group->erase(document_id) == 0)
+		{
+			continue;
+		}
+
+		duplicate_ids_.erase(document_id);
+
+		if(group->empty())
+		{
+			groups.erase(group);
+		}
+		else
+		{
+			duplicate_ids_.erase(*group->begin());
+		}
+		break;
 	}
 
-	return {text, false, IsStopWord(std::string(text))};
+	if(groups.empty())
+	{
+		fingerprint_to_ids_.erase(it);
+	}
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus doc_status) const
 {
-	std::deque<std::string_view> words = SplitIntoWordsNoStop(text);
+	return FindTopDocuments(std::execution::seq, raw_query, [doc_status](int document_id, DocumentStatus status, int rating) { return status == doc_status; });
+}
 
-	std::deque<std::string_view> plus_words(words);
-	std::deque<std::string_view> minus_words(words);
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const
+{
+	return FindTopDocuments(std::execution::seq, raw_query, [](int document_id, DocumentStatus status, int rating) { return status == DocumentStatus::ACTUAL; });
+}
 
-	plus_words.erase(std::remove_if(plus_words.begin(), plus_words.end(), [](auto word) { return word[0] == '-';	}), plus_words.end());
-	minus_words.erase(std::remove_if(minus_words.begin(), minus_words.end(), [](auto word)	{ return word[0] != '-'; }), minus_words.end());
+std::tuple<std::vector<Document>, QueryExplanation> SearchServer::ExplainTopDocuments(const std::string_view raw_query) const
+{
+	return ExplainTopDocuments(std::execution::seq, raw_query, [](int document_id, DocumentStatus status, int rating) { return status == DocumentStatus::ACTUAL; });
+}
 
-	std::transform(minus_words.begin(), minus_words.end(), minus_words.begin(), [](auto word) {	return word.substr(1); });
+int SearchServer::GetDocumentCount() const
+{
+	return documents_.size();
+}
 
-	return {plus_words, minus_words};
+CorpusStatistics SearchServer::GetCorpusStatistics() const
+{
+	const size_t document_count = documents_.size();
+	return {document_count, document_count == 0 ? 0.0 : static_cast<double>(total_document_length_) / document_count};
 }
 
-bool SearchServer::IsValidWord(const std::string_view word)
+bool SearchServer::IsRankedBefore(const Document& lhs, const Document& rhs)
 {
-	bool is_valid_char = std::none_of(word.begin(), word.end(), [](char c)
+	// Relevances tie when they round to the same multiple of EPSILON. "Within EPSILON of each
+	// other" is not transitive, so it would make partial_sort undefined and let a cursor skip
+	// or repeat documents; a fixed grid keeps the order total and the same for every page.
+	const long long lhs_step = std::llround(lhs.relevance / EPSILON);
+	const long long rhs_step = std::llround(rhs.relevance / EPSILON);
+
+	if (lhs_step != rhs_step)
 	{
-		return c >= '\0' && c < ' ';
-	});
+		return lhs_step > rhs_step;
+	}
 
-	return is_valid_char && !(word.size() == 1 && word[0] == '-') && !(word.size() >= 2 && word.substr(0, 2) == "--");
+	if (lhs.rating != rhs.rating)
+	{
+		return lhs.rating > rhs.rating;
+	}
+
+	return lhs.id < rhs.id;
 }
 
-void SearchServer::CheckIsValidDocument(int document_id) const
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const
 {
-	if(document_id < 0)
+	return MatchDocument(std::execution::seq, raw_query, document_id);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy policy, const std::string_view raw_query, int document_id) const
+{
+	const Query query = ParseQuery(raw_query);
+	std::vector<std::string_view> matched_words;
+
+	for (const auto word : documents_.at(document_id).words)
 	{
-		throw std::invalid_argument("document id is less than zero");
+		if (word_to_document_freqs_.count(word) == 0)
+		{
+			continue;
+		}
+
+		if (std::count(query.plus_words.begin(), query.plus_words.end(), word) != 0)
+		{
+			matched_words.push_back(word.data());
+		}
 	}
 
-	if(documents_.count(document_id))
+	for (const auto word : query.minus_words)
 	{
-		throw std::invalid_argument("duplicate document id { id = " + std::to_string(document_id) + " }");
+		if (std::count(documents_.at(document_id).words.begin(), documents_.at(document_id).words.end(), word) != 0)
+		{
+			matched_words.clear();
+			break;
+		}
 	}
+
+	for (const auto& phrase : query.phrases)
+	{
+		if (!positional_index_.ContainsPhrase(document_id, phrase))
+		{
+			matched_words.clear();
+			break;
+		}
+	}
+    
+	return {matched_words, documents_.at(document_id).status};
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy policy, const std::string_view raw_query, int document_id) const
+{
+	Query query(ParseQuery(raw_query));
+
+	std::vector<std::string_view> matched_words(documents_.at(document_id).words.size());
+	
+	for(const auto w : documents_.at(document_id).words)
+	{
+		if(std::find(query.minus_words.begin(), query.minus_words.end(), w) != query.minus_words.end())
+		{
+			return {std::vector<std::string_view>{}, documents_.at(document_id).status};
+		}
+	}
+
+	for(const auto& phrase : query.phrases)
+	{
+		if(!positional_index_.ContainsPhrase(document_id, phrase))
+		{
+			return {std::vector<std::string_view>{}, documents_.at(document_id).status};
+		}
+	}
+
+	std::transform(policy, documents_.at(document_id).words.begin(), documents_.at(document_id).words.end(), matched_words.begin(), [&](auto word)
+	{
+		return (std::find(query.plus_words.begin(), query.plus_words.end(), word) != query.plus_words.end() ? word : std::string_view(""));
+	});
+
+	std::sort(matched_words.begin(), matched_words.end()); 
+	matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
+
+	if(!matched_words.empty() && matched_words[0] == "")
+	{
+		matched_words.erase(matched_words.begin());
+	}
+
+	return {matched_words, documents_.at(document_id).status};
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const AdaptivePolicy& policy, const std::string_view raw_query, int document_id) const
+{
+	if(policy.ShouldMatchInParallel(documents_.at(document_id).words.size()))
+	{
+		return MatchDocument(std::execution::par, raw_query, document_id);
+	}
+
+	return MatchDocument(std::execution::seq, raw_query, document_id);
+}
+
+AdaptivePolicy SearchServer::CalibrateAdaptivePolicy() const
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int REPEAT_COUNT = 3;
+	constexpr size_t MIN_SAMPLE_POSTINGS = 1024;
+	constexpr size_t MAX_SAMPLE_POSTINGS = size_t(1) << 20;
+	constexpr size_t MIN_SAMPLE_WORDS = 64;
+
+	// The fastest of a few runs, which filters out most scheduling noise.
+	const auto measure = [](const auto& run)
+	{
+		auto best = Clock::duration::max();
+
+		for(int i = 0; i < REPEAT_COUNT; ++i)
+		{
+			const auto start = Clock::now();
+			run();
+			best = std::min(best, Clock::now() - start);
+		}
+
+		return best;
+	};
+
+	const size_t max_threads = SearchThreadPool::Shared().GetThreadCount();
+	const auto accept_all = [](int, DocumentStatus, int) { return true; };
+
+	AdaptivePolicy policy;
+	policy.search_levels.clear();
+	policy.min_parallel_match_words = AdaptivePolicy::NEVER;
+
+	if(max_threads < 2)
+	{
+		return policy;
+	}
+
+	// Sample searches read about 4x more postings each. Each has enough words for every
+	// thread, taken from the posting lists closest to an equal share of the sample.
+	const size_t query_word_count = std::max<size_t>(8, max_threads);
+	std::vector<std::pair<size_t, std::string_view>> words;
+
+	for(const auto& [word, postings] : word_to_document_freqs_)
+	{
+		if(!postings.empty())
+		{
+			words.emplace_back(postings.size(), word);
+		}
+	}
+
+	std::sort(words.begin(), words.end());
+
+	std::vector<std::pair<size_t, Query>> samples;
+
+	for(size_t target = MIN_SAMPLE_POSTINGS; target <= MAX_SAMPLE_POSTINGS; target *= 4)
+	{
+		const auto end = std::upper_bound(words.begin(), words.end(), std::make_pair(target / query_word_count, std::string_view()),
+			[](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+		if(static_cast<size_t>(end - words.begin()) < query_word_count)
+		{
+			continue;
+		}
+
+		Query query;
+		size_t posting_count = 0;
+
+		for(auto it = end - query_word_count; it != end; ++it)
+		{
+			query.plus_words.push_back(it->second);
+			posting_count += it->first;
+		}
+
+		// Too few long lists to come near the target; a larger target won't do better.
+		if(posting_count * 2 < target)
+		{
+			break;
+		}
+
+		std::sort(query.plus_words.begin(), query.plus_words.end());
+		samples.emplace_back(posting_count, std::move(query));
+	}
+
+	SearchOptions all_documents;
+	all_documents.limit = std::numeric_limits<size_t>::max();
+	std::vector<Clock::duration> best_times;
+
+	for(const auto& [posting_count, query] : samples)
+	{
+		best_times.push_back(measure([&] { FindAllDocuments(std::execution::seq, query, accept_all, all_documents, TfIdfRanking{}); }));
+	}
+
+	for(size_t threads = 2; threads <= max_threads; threads *= 2)
+	{
+		// The smallest sample on which these threads beat every smaller count.
+		size_t min_postings = AdaptivePolicy::NEVER;
+
+		for(size_t i = 0; i < samples.size(); ++i)
+		{
+			const auto& [posting_count, query] = samples[i];
+			const auto time = measure([&] { FindAllDocuments(PooledPolicy{threads}, query, accept_all, all_documents, TfIdfRanking{}); });
+
+			if(time < best_times[i])
+			{
+				best_times[i] = time;
+				min_postings = std::min(min_postings, posting_count);
+			}
+		}
+
+		if(min_postings == AdaptivePolicy::NEVER)
+		{
+			break;
+		}
+
+		const size_t previous = policy.search_levels.empty() ? 0 : policy.search_levels.back().second;
+		policy.search_levels.emplace_back(threads, std::max(min_postings, previous));
+	}
+
+	// Matches: the longest documents at roughly 4x more words each.
+	std::vector<std::pair<size_t, int>> document_sizes;
+
+	for(const auto& [document_id, data] : documents_)
+	{
+		document_sizes.emplace_back(data.words.size(), document_id);
+	}
+
+	std::sort(document_sizes.begin(), document_sizes.end());
+
+	for(size_t target = MIN_SAMPLE_WORDS; !document_sizes.empty() && target <= document_sizes.back().first; target *= 4)
+	{
+		const int document_id = std::lower_bound(document_sizes.begin(), document_sizes.end(), std::make_pair(target, std::numeric_limits<int>::min()))->second;
+		const auto& document_words = documents_.at(document_id).words;
+		std::string raw_query;
+
+		for(const auto word : document_words)
+		{
+			raw_query += raw_query.empty() ? "" : " ";
+			raw_query += word;
+
+			if(raw_query.size() > 64)
+			{
+				break;
+			}
+		}
+
+		const auto sequential_time = measure([&] { MatchDocument(std::execution::seq, raw_query, document_id); });
+		const auto parallel_time = measure([&] { MatchDocument(std::execution::par, raw_query, document_id); });
+
+		if(parallel_time < sequential_time)
+		{
+			policy.min_parallel_match_words = document_words.size();
+			break;
+		}
+	}
+
+	return policy;
+}
+
+std::pmr::set<int>::iterator SearchServer::begin() const
+{
+	return document_ids_.begin();
+}
+
+std::pmr::set<int>::iterator SearchServer::end() const
+{
+	return document_ids_.end();
+}
+
+const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
+{
+	static std::map<std::string_view, double> result;
+
+	for(auto& [str, freq_map] : word_to_document_freqs_)
+	{
+		auto it = freq_map.find(document_id);
+
+		if(it != freq_map.end())
+		{
+			result[str] = it->second;
+		}
+	}
+
+	return result;
+}
+
+void SearchServer::RemoveDocument(int document_id)
+{    
+  RemoveDocument(std::execution::seq, document_id);
+}
+
+void SearchServer::RemoveDocument(std::execution::sequenced_policy policy, int document_id)
+{
+	if(duplicate_handling_ != DuplicateHandling::IGNORE)
+	{
+		UnregisterFingerprint(document_id);
+	}
+
+	std::vector<std::string_view> words_ids(documents_[document_id].words.begin(), documents_[document_id].words.end());
+
+	std::for_each(policy, words_ids.begin(), words_ids.end(), [document_id, this](std::string_view word)
+	{
+		word_to_document_freqs_.at(word).erase(document_id);
+	});
+
+	positional_index_.RemoveDocument(document_id);
+	InvalidateImpactIndex();
+	total_document_length_ -= documents_[document_id].length;
+	document_ids_.erase(document_id);
+	documents_.erase(document_id);
+}
+
+void SearchServer::RemoveDocument(std::execution::parallel_policy policy, int document_id)
+{
+	if(duplicate_handling_ != DuplicateHandling::IGNORE)
+	{
+		UnregisterFingerprint(document_id);
+	}
+
+	std::vector<std::string_view> words_ids(documents_[document_id].words.begin(), documents_[document_id].words.end());
+	std::vector<std::pmr::map<int, double>::node_type> nodes(words_ids.size());
+
+	// Unlinking runs in parallel; the nodes go back to the pool on this thread.
+	std::transform(policy, words_ids.begin(), words_ids.end(), nodes.begin(), [document_id, this](std::string_view word)
+	{
+		return word_to_document_freqs_.find(word)->second.extract(document_id);
+	});
+
+	nodes.clear();
+
+	positional_index_.RemoveDocument(document_id);
+	InvalidateImpactIndex();
+	total_document_length_ -= documents_[document_id].length;
+	document_ids_.erase(document_id);
+	documents_.erase(document_id);
+}
+
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids)
+{
+	RemoveDocuments(std::execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(std::execution::sequenced_policy policy, const std::vector<int>& document_ids)
+{
+	RemoveDocumentsImpl(policy, document_ids);
+}
+
+void SearchServer::RemoveDocuments(std::execution::parallel_policy policy, const std::vector<int>& document_ids)
+{
+	RemoveDocumentsImpl(policy, document_ids);
+}
+
+template<typename Policy>
+void SearchServer::RemoveDocumentsImpl(Policy policy, const std::vector<int>& document_ids)
+{
+	std::vector<int> ids;
+	ids.reserve(document_ids.size());
+
+	for(const int document_id : document_ids)
+	{
+		if(documents_.count(document_id) != 0)
+		{
+			ids.push_back(document_id);
+		}
+	}
+
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	if(ids.empty())
+	{
+		return;
+	}
+
+	// ids is sorted, so every term's list of removals comes out sorted as well.
+	std::unordered_map<std::string_view, std::vector<int>> removals_by_word;
+
+	for(const int document_id : ids)
+	{
+		for(const std::string_view word : documents_.at(document_id).words)
+		{
+			removals_by_word[word].push_back(document_id);
+		}
+	}
+
+	std::vector<std::pair<std::pmr::map<int, double>*, std::vector<int>>> removals;
+	removals.reserve(removals_by_word.size());
+
+	for(auto& [word, word_ids] : removals_by_word)
+	{
+		removals.emplace_back(word_postings_.at(word), std::move(word_ids));
+	}
+
+	using Node = std::pmr::map<int, double>::node_type;
+	std::vector<std::vector<Node>> nodes(removals.size());
+
+	// Each posting list is touched by one task only; the nodes go back to the
+	// pool on this thread once every list has been unlinked.
+	std::transform(policy, removals.begin(), removals.end(), nodes.begin(), [](const auto& removal)
+	{
+		auto& [postings, word_ids] = removal;
+		std::vector<Node> extracted;
+		extracted.reserve(word_ids.size());
+
+		// A handful of ids in a long list is cheaper to look up than to walk to.
+		if(word_ids.size() * 16 < postings->size())
+		{
+			for(const int document_id : word_ids)
+			{
+				extracted.push_back(postings->extract(document_id));
+			}
+
+			return extracted;
+		}
+
+		auto it = postings->lower_bound(word_ids.front());
+
+		for(const int document_id : word_ids)
+		{
+			while(it->first < document_id)
+			{
+				++it;
+			}
+
+			extracted.push_back(postings->extract(it++));
+		}
+
+		return extracted;
+	});
+
+	nodes.clear();
+
+	for(const int document_id : ids)
+	{
+		if(duplicate_handling_ != DuplicateHandling::IGNORE)
+		{
+			UnregisterFingerprint(document_id);
+		}
+
+		positional_index_.RemoveDocument(document_id);
+
+		const auto document = documents_.find(document_id);
+		total_document_length_ -= document->second.length;
+		documents_.erase(document);
+		document_ids_.erase(document_id);
+	}
+
+	// IDF is derived from the posting sizes at query time; only the impact snapshot is stale.
+	InvalidateImpactIndex();
+}
+
+std::set<int> SearchServer::GetDuplicatedIds() const
+{
+	if(duplicate_handling_ != DuplicateHandling::IGNORE)
+	{
+		return duplicate_ids_;
+	}
+
+	std::vector<const std::pair<const int, DocumentData>*> documents;
+	documents.reserve(documents_.size());
+
+	for(const auto& document : documents_)
+	{
+		documents.push_back(&document);
+	}
+
+	std::vector<DocumentFingerprint> fingerprints(documents.size());
+
+	std::transform(std::execution::par, documents.begin(), documents.end(), fingerprints.begin(), [](const auto* document)
+	{
+		return ComputeDocumentFingerprint(document->second.words);
+	});
+
+	std::set<int> result;
+	std::unordered_map<DocumentFingerprint, std::vector<int>, DocumentFingerprintHasher> representatives;
+	representatives.reserve(documents.size());
+
+	// documents_ is ordered by id, so the first document of every group is the one that survives.
+	for(size_t i = 0; i < documents.size(); ++i)
+	{
+		const auto& [document_id, data] = *documents[i];
+		auto& group = representatives[fingerprints[i]];
+
+		const bool is_duplicate = std::any_of(group.begin(), group.end(), [this, &data](int representative_id)
+		{
+			return documents_.at(representative_id).words == data.words;
+		});
+
+		if(is_duplicate)
+		{
+			result.emplace(document_id);
+		}
+		else
+		{
+			group.push_back(document_id);
+		}
+	}
+
+	return result;
+}
+
+bool SearchServer::IsDuplicate(int document_id) const
+{
+	if(duplicate_handling_ != DuplicateHandling::IGNORE)
+	{
+		return duplicate_ids_.count(document_id) != 0;
+	}
+
+	return GetDuplicatedIds().count(document_id) != 0;
+}
+
+std::vector<std::vector<int>> SearchServer::GetNearDuplicateClusters(const NearDuplicateOptions& options) const
+{
+	std::vector<int> document_ids;
+	std::vector<const std::pmr::unordered_set<std::string_view>*> document_words;
+	document_ids.reserve(documents_.size());
+	document_words.reserve(documents_.size());
+
+	for(const auto& [document_id, data] : documents_)
+	{
+		document_ids.push_back(document_id);
+		document_words.push_back(&data.words);
+	}
+
+	return FindNearDuplicateClusters(document_ids, document_words, options);
+}
+
+MemoryUsageReport SearchServer::MemoryUsage() const
+{
+	MemoryUsageReport report;
+	report.term_dictionary = memory_->term_dictionary.GetBytes();
+	report.postings = memory_->postings.GetBytes();
+	report.documents = memory_->documents.GetBytes();
+	report.document_ids = memory_->document_ids.GetBytes();
+	report.stop_words = memory_->stop_words.GetBytes();
+
+	return report;
+}
+
+LatencyHistogram SearchServer::GetPostingLengthHistogram() const
+{
+	LatencyHistogram histogram;
+
+	for(const auto& [word, postings] : word_to_document_freqs_)
+	{
+		if(!postings.empty())
+		{
+			histogram.Record(postings.size());
+		}
+	}
+
+	return histogram;
+}
+
+LatencyHistogram SearchServer::GetDocumentLengthHistogram() const
+{
+	LatencyHistogram histogram;
+
+	for(const auto& [document_id, data] : documents_)
+	{
+		histogram.Record(data.length);
+	}
+
+	return histogram;
+}
+
+void SearchServer::BuildImpactIndex(ImpactLayout layout)
+{
+	impact_index_ = std::make_shared<const ImpactIndex>(word_to_document_freqs_, documents_, layout);
+}
+
+void SearchServer::InvalidateImpactIndex()
+{
+	if(impact_index_)
+	{
+		impact_index_.reset();
+		RECORD_VALUE("index.impact.invalidated", 1);
+	}
+}
+
+bool SearchServer::HasImpactIndex() const
+{
+	return impact_index_ != nullptr;
+}
+
+const ImpactIndex* SearchServer::GetImpactIndex() const
+{
+	return impact_index_.get();
+}
+
+bool SearchServer::IsStopWord(const std::string_view word) const
+{
+	return stop_words_.find(word) != stop_words_.end();
+}
+
+std::deque<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const
+{
+	using namespace std::string_literals;
+
+	std::vector<std::string_view> in_words(SplitIntoWords(text));
+	std::deque<std::string_view> words(in_words.size());
+
+	for (const auto word : in_words)
+	{
+		if(!IsValidWord(word))
+		{
+			throw std::invalid_argument("word {"s + std::string(word) + "} contains illegal characters"s);
+		}
+	}
+  
+	std::transform(in_words.begin(), in_words.end(), words.begin(), [this](auto word)
+	{
+		return !IsStopWord(word) ? word : std::string_view("");
+	});
+
+	words.erase(std::remove_if(words.begin(), words.end(), [](auto word) { return word.empty();	}), words.end());
+	
+	return words;
+}
+
+int SearchServer::ComputeAverageRating(const std::vector<int>& ratings)
+{
+	if (ratings.empty())
+	{
+		return 0;
+	}
+
+	int rating_sum = accumulate(ratings.begin(), ratings.end(), 0);
+	return rating_sum / static_cast<int>(ratings.size());
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const
+{
+	using namespace std::string_literals;
+
+	if(!IsValidWord(text))
+	{
+		throw std::invalid_argument("word contains illegal characters"s);
+	}
+
+	if (text[0] == '-')
+	{
+		return {text.substr(1), true, IsStopWord(text.substr(1))};
+	}
+
+	return {text, false, IsStopWord(text)};
+}
+
+SearchServer::Query SearchServer::ParseSearchQuery(const std::string_view raw_query) const
+{
+	RECORD_DURATION("query.parse");
+
+	Query query = ParseQuery(raw_query);
+
+	std::sort(query.plus_words.begin(), query.plus_words.end()); 
+	auto last_plus = std::unique(query.plus_words.begin(), query.plus_words.end());
+	query.plus_words.erase(last_plus, query.plus_words.end());
+
+	std::sort(query.minus_words.begin(), query.minus_words.end()); 
+	auto last_minus = std::unique(query.minus_words.begin(), query.minus_words.end());
+	query.minus_words.erase(last_minus, query.minus_words.end());
+
+	std::sort(query.required_words.begin(), query.required_words.end());
+	query.required_words.erase(std::unique(query.required_words.begin(), query.required_words.end()), query.required_words.end());
+
+	return query;
+}
+
+std::vector<std::string> SearchServer::FindQueryStopWords(const std::string_view raw_query) const
+{
+	std::vector<std::string> result;
+
+	for(auto word : SplitIntoWords(raw_query))
+	{
+		// Quotes are query syntax, not part of the word. "-word" is kept whole: a minus
+		// word is never dropped as a stop word.
+		while(!word.empty() && word.front() == '"')
+		{
+			word.remove_prefix(1);
+		}
+
+		while(!word.empty() && word.back() == '"')
+		{
+			word.remove_suffix(1);
+		}
+
+		if(!word.empty() && IsStopWord(word) && std::find(result.begin(), result.end(), word) == result.end())
+		{
+			result.emplace_back(word);
+		}
+	}
+
+	return result;
+}
+
+SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const
+{
+	using namespace std::string_literals;
+
+	Query query;
+	std::unordered_map<std::string_view, double> fuzzy_weights;
+
+	const auto add_words = [this, &query, &fuzzy_weights](std::string_view segment)
+	{
+		for(const auto word : SplitIntoWordsNoStop(segment))
+		{
+			const bool is_minus = word[0] == '-';
+			const std::string_view data = is_minus ? word.substr(1) : word;
+			auto& words = is_minus ? query.minus_words : query.plus_words;
+
+			const size_t tilde = data.rfind('~');
+			const std::string_view distance = tilde == std::string_view::npos ? std::string_view() : data.substr(tilde + 1);
+
+			// "word~" and "word~N" are fuzzy; a tilde followed by anything else is part of the word.
+			if(!is_minus && tilde != std::string_view::npos && tilde > 0 && distance.size() <= 1 && (distance.empty() || std::isdigit(static_cast<unsigned char>(distance[0]))))
+			{
+				const int max_distance = distance.empty() ? 1 : distance[0] - '0';
+
+				if(max_distance > MAX_FUZZY_DISTANCE)
+				{
+					throw std::invalid_argument("fuzzy distance of word {"s + std::string(data) + "} exceeds "s + std::to_string(MAX_FUZZY_DISTANCE));
+				}
+
+				std::unordered_map<std::string_view, double> term_weights;
+				ExpandFuzzy(data.substr(0, tilde), max_distance, term_weights);
+				auto& alternative = query.alternatives.emplace_back();
+
+				for(const auto& [term, weight] : term_weights)
+				{
+					alternative.push_back(term);
+					auto [it, inserted] = fuzzy_weights.emplace(term, weight);
+
+					if(!inserted)
+					{
+						it->second = std::max(it->second, weight);
+					}
+				}
+			}
+			else if(data.size() > 1 && data.back() == '*')
+			{
+				std::vector<std::string_view> expansions = ExpandPrefix(data.substr(0, data.size() - 1));
+				// The cap bounds scoring work only; what a document must have or must not have
+				// is decided by every expansion.
+				const size_t scored = is_minus ? expansions.size() : std::min(expansions.size(), MAX_PREFIX_EXPANSION);
+				RECORD_VALUE("query.expand.terms", scored);
+				words.insert(words.end(), expansions.begin(), expansions.begin() + scored);
+
+				if(!is_minus)
+				{
+					query.alternatives.push_back(std::move(expansions));
+				}
+			}
+			else
+			{
+				words.push_back(data);
+
+				if(!is_minus)
+				{
+					query.required_words.push_back(data);
+				}
+			}
+		}
+	};
+
+	size_t begin = 0;
+
+	while(true)
+	{
+		const size_t opening = text.find('"', begin);
+		add_words(text.substr(begin, opening == std::string_view::npos ? std::string_view::npos : opening - begin));
+
+		if(opening == std::string_view::npos)
+		{
+			break;
+		}
+
+		const size_t closing = text.find('"', opening + 1);
+
+		if(closing == std::string_view::npos)
+		{
+			throw std::invalid_argument("query contains an unterminated phrase"s);
+		}
+
+		Phrase phrase = ParsePhrase(text.substr(opening + 1, closing - opening - 1));
+
+		for(const auto& term : phrase)
+		{
+			query.plus_words.push_back(term.word);
+			query.required_words.push_back(term.word);
+		}
+
+		if(phrase.size() > 1)
+		{
+			query.phrases.push_back(std::move(phrase));
+		}
+
+		begin = closing + 1;
+	}
+
+	// A word the query also names exactly keeps its full weight.
+	if(!fuzzy_weights.empty())
+	{
+		const std::unordered_set<std::string_view> exact_words(query.plus_words.begin(), query.plus_words.end());
+
+		for(const auto& [word, weight] : fuzzy_weights)
+		{
+			if(exact_words.count(word) == 0)
+			{
+				query.plus_words.push_back(word);
+				query.plus_word_weights.emplace(word, weight);
+			}
+		}
+	}
+
+	return query;
+}
+
+Phrase SearchServer::ParsePhrase(const std::string_view text) const
+{
+	using namespace std::string_literals;
+
+	Phrase phrase;
+	uint32_t offset = 0;
+
+	for(const auto word : SplitIntoWords(text))
+	{
+		if(word.empty())
+		{
+			continue;
+		}
+
+		if(!IsValidWord(word))
+		{
+			throw std::invalid_argument("word {"s + std::string(word) + "} contains illegal characters"s);
+		}
+
+		if(!IsStopWord(word))
+		{
+			phrase.push_back({word, offset});
+		}
+
+		++offset;
+	}
+
+	return phrase;
+}
+
+std::vector<std::string_view> SearchServer::ExpandPrefix(const std::string_view prefix) const
+{
+	RECORD_DURATION("query.expand");
+
+	std::vector<std::pair<size_t, std::string_view>> expansions;
+
+	terms_.ForEachWithPrefix(prefix, [this, &expansions](std::string_view term)
+	{
+		// The dictionary outlives removed documents, so only words still indexed count.
+		const auto it = word_to_document_freqs_.find(term);
+
+		if(it != word_to_document_freqs_.end() && !it->second.empty())
+		{
+			expansions.emplace_back(it->second.size(), term);
+		}
+
+		return true;
+	});
+
+	if(expansions.size() > MAX_PREFIX_EXPANSION)
+	{
+		std::nth_element(expansions.begin(), expansions.begin() + MAX_PREFIX_EXPANSION, expansions.end(), [](const auto& lhs, const auto& rhs)
+		{
+			return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+		});
+	}
+
+	std::vector<std::string_view> words;
+	words.reserve(expansions.size());
+
+	for(const auto& [document_count, term] : expansions)
+	{
+		words.push_back(term);
+	}
+
+	return words;
+}
+
+void SearchServer::ExpandFuzzy(const std::string_view word, int max_distance, std::unordered_map<std::string_view, double>& word_weights) const
+{
+	RECORD_DURATION("query.fuzzy");
+
+	struct Candidate
+	{
+		int distance;
+		size_t document_count;
+		std::string_view term;
+	};
+
+	std::vector<Candidate> candidates;
+
+	terms_.ForEachWithinDistance(word, max_distance, [this, &candidates](std::string_view term, int distance)
+	{
+		const auto it = word_to_document_freqs_.find(term);
+
+		if(it != word_to_document_freqs_.end() && !it->second.empty())
+		{
+			candidates.push_back({distance, it->second.size(), term});
+		}
+	});
+
+	if(candidates.size() > MAX_FUZZY_EXPANSION)
+	{
+		std::nth_element(candidates.begin(), candidates.begin() + MAX_FUZZY_EXPANSION, candidates.end(), [](const Candidate& lhs, const Candidate& rhs)
+		{
+			return std::tie(lhs.distance, rhs.document_count, lhs.term) < std::tie(rhs.distance, lhs.document_count, rhs.term);
+		});
+		candidates.resize(MAX_FUZZY_EXPANSION);
+	}
+
+	RECORD_VALUE("query.fuzzy.terms", candidates.size());
+
+	for(const auto& candidate : candidates)
+	{
+		const double weight = std::pow(1.0 - fuzzy_penalty_, candidate.distance);
+		auto [it, inserted] = word_weights.emplace(candidate.term, weight);
+
+		if(!inserted)
+		{
+			it->second = std::max(it->second, weight);
+		}
+	}
+}
+
+std::vector<int> SearchServer::IntersectPostings(const std::deque<std::string_view>& words, size_t& postings_read) const
+{
+	std::vector<int> result;
+
+	// The snapshot's flat slot arrays are in document order and intersect far faster than map nodes.
+	if(impact_index_ && impact_index_->GetLayout() == ImpactLayout::DOCUMENT_ORDERED)
+	{
+		for(const uint32_t slot : impact_index_->Intersect(words, postings_read))
+		{
+			result.push_back(impact_index_->GetDocument(slot).id);
+		}
+
+		return result;
+	}
+
+	struct Cursor
+	{
+		const std::pmr::map<int, double>* postings;
+		std::pmr::map<int, double>::const_iterator position;
+	};
+
+	std::vector<Cursor> cursors;
+
+	for(const auto word : words)
+	{
+		const auto it = word_to_document_freqs_.find(word);
+
+		if(it == word_to_document_freqs_.end() || it->second.empty())
+		{
+			return {};
+		}
+
+		cursors.push_back({&it->second, it->second.begin()});
+	}
+
+	if(cursors.empty())
+	{
+		return {};
+	}
+
+	std::sort(cursors.begin(), cursors.end(), [](const Cursor& lhs, const Cursor& rhs) { return lhs.postings->size() < rhs.postings->size(); });
+
+	// Leapfrog: every cursor in turn seeks the current target; one that overshoots it sets
+	// the next target, and a target all cursors agree on is a match.
+	int target = cursors.front().position->first;
+	size_t agreeing = 0;
+
+	for(size_t i = 0;; i = (i + 1) % cursors.size())
+	{
+		Cursor& cursor = cursors[i];
+
+		if(cursor.position->first < target)
+		{
+			cursor.position = cursor.postings->lower_bound(target);
+			++postings_read;
+
+			if(cursor.position == cursor.postings->end())
+			{
+				break;
+			}
+		}
+
+		if(cursor.position->first > target)
+		{
+			target = cursor.position->first;
+			agreeing = 1;
+			continue;
+		}
+
+		if(++agreeing < cursors.size())
+		{
+			continue;
+		}
+
+		result.push_back(target);
+		++postings_read;
+
+		if(++cursor.position == cursor.postings->end())
+		{
+			break;
+		}
+
+		target = cursor.position->first;
+		agreeing = 1;
+	}
+
+	return result;
+}
+
+std::vector<int> SearchServer::FindPhraseMatches(const Query& query) const
+{
+	std::vector<int> result;
+	bool is_first = true;
+
+	for(const auto& phrase : query.phrases)
+	{
+		std::vector<const std::pmr::map<int, double>*> postings;
+
+		for(const auto& term : phrase)
+		{
+			const auto it = word_to_document_freqs_.find(term.word);
+
+			if(it == word_to_document_freqs_.end())
+			{
+				return {};
+			}
+
+			postings.push_back(&it->second);
+		}
+
+		std::sort(postings.begin(), postings.end(), [](const auto* lhs, const auto* rhs) { return lhs->size() < rhs->size(); });
+
+		// Positions are decoded only for documents that hold every word of the phrase.
+		std::vector<int> matches;
+
+		for(const auto& [document_id, frequency] : *postings.front())
+		{
+			if(!is_first && !std::binary_search(result.begin(), result.end(), document_id))
+			{
+				continue;
+			}
+
+			const bool has_all_words = std::all_of(postings.begin() + 1, postings.end(), [document_id = document_id](const auto* posting)
+			{
+				return posting->count(document_id) != 0;
+			});
+
+			if(has_all_words && positional_index_.ContainsPhrase(document_id, phrase))
+			{
+				matches.push_back(document_id);
+			}
+		}
+
+		result = std::move(matches);
+		is_first = false;
+
+		if(result.empty())
+		{
+			break;
+		}
+	}
+
+	return result;
+}
+
+bool SearchServer::IsValidWord(const std::string_view word)
+{
+	bool is_valid_char = std::none_of(word.begin(), word.end(), [](char c)
+	{
+		return c >= '\0' && c < ' ';
+	});
+
+	return is_valid_char && !(word.size() == 1 && word[0] == '-') && !(word.size() >= 2 && word.substr(0, 2) == "--");
+}
+
+void SearchServer::CheckIsValidDocument(int document_id) const
+{
+	if(document_id < 0)
+	{
+		throw std::invalid_argument("document id is less than zero");
+	}
+
+	if(documents_.count(document_id))
+	{
+		throw std::invalid_argument("duplicate document id { id = " + std::to_string(document_id) + " }");
+	}
+}
+
+SearchServer::ScratchLease::ScratchLease()
+{
+	thread_local QueryScratch thread_scratch;
+
+	// A predicate that searches again on the same thread gets its own scratch.
+	if(thread_scratch.in_use)
+	{
+		fallback_ = std::make_unique<QueryScratch>();
+		scratch_ = fallback_.get();
+	}
+	else
+	{
+		scratch_ = &thread_scratch;
+	}
+
+	scratch_->in_use = true;
+}
+
+SearchServer::ScratchLease::~ScratchLease()
+{
+	auto& document_to_relevance = scratch_->document_to_relevance;
+
+	// clear() touches every bucket, so a table blown up by one huge query is dropped
+	// instead of taxing every small query that follows it.
+	if(document_to_relevance.bucket_count() > 4096 && document_to_relevance.size() * 8 < document_to_relevance.bucket_count())
+	{
+		document_to_relevance = {};
+	}
+	else
+	{
+		document_to_relevance.clear();
+	}
+
+	scratch_->in_use = false;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string& word) const
+SearchServer::QueryScratch& SearchServer::ScratchLease::Get()
 {
-	return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+	return *scratch_;
 }
 
 std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentStatus document_status) const
@@ -10,15 +10,50 @@
 #include <numeric>
 #include <sstream>
 #include <unordered_set>
+#include <unordered_map>
 #include <execution>
 #include <chrono>
 #include <unordered_set>
 #include <list>
 #include <deque>
 #include <string_view>
+#include <memory>
+#include <type_traits>
+#include <optional>
+#include <limits>
+#include <memory_resource>
+#include <functional>
+#include <atomic>
 #include "document.h"
 #include "log_duration.h"
 #include "concurrent_map.h"
+#include "near_duplicates.h"
+#include "document_fingerprint.h"
+#include "paginator.h"
+#include "positional_index.h"
+#include "term_dictionary.h"
+#include "ranking.h"
+#include "impact_index.h"
+#include "memory_accounting.h"
+#include "query_explanation.h"
+#include "adaptive_policy.h"
+#include "search_thread_pool.h"
+
+enum class DuplicateHandling
+{
+	IGNORE,
+	TRACK,
+	REJECT,
+};
+
+// ANY matches documents with at least one plus word, ALL only those with every one of them.
+enum class MatchMode
+{
+	ANY,
+	ALL,
+};
+
+struct SearchOptions;
 
 class SearchServer
 {
@@ -26,8 +61,19 @@ public:
 
 	inline static constexpr int MAX_RESULT_DOCUMENT_COUNT = 5;
 	inline static constexpr double EPSILON = 1e-6;
+	// A "prefix*" plus word is scored as at most this many indexed words, the ones in the most
+	// documents. Minus words, and the expansion MatchMode::ALL requires one word of, use them all.
+	inline static constexpr size_t MAX_PREFIX_EXPANSION = 64;
+	// A "word~N" query word stands for at most this many indexed words within N edits, closest first.
+	inline static constexpr size_t MAX_FUZZY_EXPANSION = 64;
+	inline static constexpr int MAX_FUZZY_DISTANCE = 2;
 
 	SearchServer(){};
+	SearchServer(SearchServer&& other) = default;
+	// Containers keep the memory resources they were built with, so a server can't take
+	// over another one's contents by assignment.
+	SearchServer& operator=(SearchServer&& other) = delete;
+	~SearchServer();
 
 	explicit SearchServer(const std::string& words);
 
@@ -36,7 +82,63 @@ public:
 
 	void SetStopWords(const std::string_view text);
 
-	void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+	void SetDuplicateHandling(DuplicateHandling handling);
+
+	// A word matched through "word~N" with d edits contributes its relevance times (1 - penalty)^d.
+	void SetFuzzyPenalty(double penalty);
+
+	// With index_positions the document also keeps its word positions, which quoted
+	// phrase queries need: documents without them never match a phrase.
+	void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings, bool index_positions = false);
+
+	// A document split into words and counted, but not indexed yet. Its words view either the
+	// original text or any other storage that outlives AddPreparedDocument.
+	struct PreparedDocument
+	{
+		int id = 0;
+		DocumentStatus status = DocumentStatus::ACTUAL;
+		int rating = 0;
+		size_t length = 0;
+		std::vector<std::pair<std::string_view, uint32_t>> word_counts;
+		bool index_positions = false;
+		std::vector<std::pair<std::string_view, uint32_t>> word_positions;
+	};
+
+	// AddDocument in two stages. Preparing only reads the stop words, so any number of threads
+	// may prepare at once; adding modifies the index and must not race with anything else.
+	PreparedDocument PrepareDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings, bool index_positions = false) const;
+	void AddPreparedDocument(const PreparedDocument& document);
+
+	// A word interned by the server and its posting list; both live as long as the server.
+	struct TermSlot
+	{
+		std::string_view word;
+		std::pmr::map<int, double>* postings = nullptr;
+	};
+
+	// Interns word, with an empty posting list if it is new, so that callers who keep the slot
+	// never have to look the word up again.
+	TermSlot GetTermSlot(const std::string_view word);
+
+	// The (document id, term frequency) pairs a batch adds to one term, in any order.
+	struct TermPostings
+	{
+		TermSlot slot;
+		std::vector<std::pair<int, double>> postings;
+	};
+
+	// AddPreparedDocument for a batch whose words, positions included, all come from
+	// GetTermSlot and whose postings are already grouped by term; ids must be distinct.
+	// Documents are registered in order on this thread, then each term's postings are merged
+	// into its list by a task of its own. Returns the ids of the documents that were rejected,
+	// ascending; their postings are skipped.
+	std::vector<int> AddPreparedDocuments(const std::vector<PreparedDocument>& documents, std::vector<TermPostings>& postings);
+	std::vector<int> AddPreparedDocuments(std::execution::parallel_policy policy, const std::vector<PreparedDocument>& documents, std::vector<TermPostings>& postings);
+	std::vector<int> AddPreparedDocuments(std::execution::sequenced_policy policy, const std::vector<PreparedDocument>& documents, std::vector<TermPostings>& postings);
+
+	// A word occurring count times among document_length words. The frequency is summed one
+	// occurrence at a time, so every way of adding a document gives the same bits.
+	static double ComputeTermFrequency(uint32_t count, size_t document_length);
 
 	template<typename T>
 	std::vector<Document> FindTopDocuments(const std::string_view raw_query, T predicate) const;
@@ -44,6 +146,22 @@ public:
 	template<typename T, typename Policy>
 	std::vector<Document> FindTopDocuments(Policy polycy, const std::string_view raw_query, T predicate) const;
 
+	template<typename T, typename Policy>
+	std::vector<Document> FindTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options) const;
+
+	// Scores with ranking instead of TF-IDF, e.g. Bm25Ranking{} (see ranking.h).
+	template<typename T, typename Policy, typename Ranking>
+	std::vector<Document> FindTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options, const Ranking& ranking) const;
+
+	// Appends the results to output and returns their count. Spares a result vector per
+	// query where the caller collects the results of many.
+	template<typename T, typename Policy>
+	size_t AppendTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options, std::vector<Document>& output) const;
+
+	template<typename T>
+	auto PaginateTopDocuments(const std::string_view raw_query, size_t page_size, T predicate) const;
+	auto PaginateTopDocuments(const std::string_view raw_query, size_t page_size) const;
+
 	template<typename Policy>
 	std::vector<Document> FindTopDocuments(Policy polycy, const std::string_view raw_query, DocumentStatus doc_status) const;	
 	std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus doc_status) const;
@@ -52,14 +170,38 @@ public:
 	std::vector<Document> FindTopDocuments(Policy polycy, const std::string_view raw_query) const;
 	std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
 
+	// Reports the search to trace through the hooks of QueryTrace (see query_explanation.h).
+	template<typename T, typename Policy, typename Ranking, typename Trace>
+	std::vector<Document> FindTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options, const Ranking& ranking, Trace& trace) const;
+
+	// FindTopDocuments that also reports how the query ran: parsed terms, stage sizes and
+	// stage times. The tracing is compiled only into these overloads.
+	template<typename T, typename Policy, typename Ranking>
+	std::tuple<std::vector<Document>, QueryExplanation> ExplainTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options, const Ranking& ranking) const;
+	template<typename T, typename Policy>
+	std::tuple<std::vector<Document>, QueryExplanation> ExplainTopDocuments(Policy policy, const std::string_view raw_query, T predicate) const;
+	std::tuple<std::vector<Document>, QueryExplanation> ExplainTopDocuments(const std::string_view raw_query) const;
+
 	int GetDocumentCount() const;
 
+	CorpusStatistics GetCorpusStatistics() const;
+
+	// Result order: relevance descending (rounded to a multiple of EPSILON), then rating descending,
+	// then id ascending. A strict weak ordering, so it serves sorting and cursors alike.
+	static bool IsRankedBefore(const Document& lhs, const Document& rhs);
+
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy policy, const std::string_view raw_query, int document_id) const;
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy policy, const std::string_view raw_query, int document_id) const;
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const AdaptivePolicy& policy, const std::string_view raw_query, int document_id) const;
+
+	// Times sequential and parallel searches and matches over this index's own postings and
+	// documents and returns an AdaptivePolicy with the break-even points found. Takes from
+	// milliseconds to a few seconds depending on the index size and core count.
+	AdaptivePolicy CalibrateAdaptivePolicy() const;
 
-	std::set<int>::iterator begin() const;
-	std::set<int>::iterator end() const;
+	std::pmr::set<int>::iterator begin() const;
+	std::pmr::set<int>::iterator end() const;
 
 	const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
@@ -67,8 +209,40 @@ public:
 	void RemoveDocument(std::execution::parallel_policy policy, int document_id);
 	void RemoveDocument(std::execution::sequenced_policy policy, int document_id);
 
+	// Removes many documents at once: the deletions are grouped by term so every posting
+	// list is visited once, and the parallel version unlinks different terms concurrently.
+	// Unknown ids are skipped.
+	void RemoveDocuments(const std::vector<int>& document_ids);
+	void RemoveDocuments(std::execution::parallel_policy policy, const std::vector<int>& document_ids);
+	void RemoveDocuments(std::execution::sequenced_policy policy, const std::vector<int>& document_ids);
+
 	std::set<int> GetDuplicatedIds() const;
 
+	bool IsDuplicate(int document_id) const;
+
+	std::vector<std::vector<int>> GetNearDuplicateClusters(const NearDuplicateOptions& options = {}) const;
+
+	// Bytes currently allocated by each index structure, counted by its allocator.
+	MemoryUsageReport MemoryUsage() const;
+
+	// Distribution of posting list lengths (documents per word) and of document lengths (words per document).
+	LatencyHistogram GetPostingLengthHistogram() const;
+	LatencyHistogram GetDocumentLengthHistogram() const;
+
+	// Snapshots the postings as quantized impacts (see impact_index.h). While it is fresh,
+	// TF-IDF top-K searches score with it and rescore only the few documents that can
+	// still reach the top exactly, so results are the same as without it. The snapshot is
+	// a copy kept beside the map postings, which rescoring and every other search still
+	// read: it adds GetPostingBytes() to the index memory and saves none. Adding or removing
+	// a document discards it, counts a sample of "index.impact.invalidated" and sends
+	// searches back to the map postings until it is built again; HasImpactIndex tells which.
+	// With IMPACT_ORDERED, searches read the highest impacts first and stop as soon as the
+	// top can't change, which pays off for small limits over long posting lists; building
+	// it sorts every posting list.
+	void BuildImpactIndex(ImpactLayout layout = ImpactLayout::DOCUMENT_ORDERED);
+	bool HasImpactIndex() const;
+	const ImpactIndex* GetImpactIndex() const;
+
 private:
 
 	struct QueryWord
@@ -82,19 +256,125 @@ private:
 	{
 		std::deque<std::string_view> plus_words;
 		std::deque<std::string_view> minus_words;
+		// Quoted phrases; their words are plus words as well.
+		std::vector<Phrase> phrases;
+		// Relevance multipliers of plus words that only came from fuzzy matching.
+		std::unordered_map<std::string_view, double> plus_word_weights;
+		// What MatchMode::ALL requires: every word named exactly, and one word of each
+		// "prefix*" or "word~N" expansion.
+		std::deque<std::string_view> required_words;
+		std::vector<std::vector<std::string_view>> alternatives;
+
+		double GetWordWeight(std::string_view word) const
+		{
+			const auto it = plus_word_weights.find(word);
+			return it == plus_word_weights.end() ? 1.0 : it->second;
+		}
+	};
+
+	// Reusable per-thread accumulator for sequential queries: cleared between queries
+	// without releasing its buckets, so long-lived search threads stop allocating them.
+	struct QueryScratch
+	{
+		std::unordered_map<int, double> document_to_relevance;
+		bool in_use = false;
+	};
+
+	class ScratchLease
+	{
+	public:
+		ScratchLease();
+		~ScratchLease();
+
+		ScratchLease(const ScratchLease&) = delete;
+		ScratchLease& operator=(const ScratchLease&) = delete;
+
+		QueryScratch& Get();
+
+	private:
+		QueryScratch* scratch_;
+		std::unique_ptr<QueryScratch> fallback_;
+	};
+
+	// Each index structure allocates through its own counting resource. All of them carve
+	// nodes from one pool, which takes large chunks from a monotonic arena: freed nodes are
+	// reused by later ones, and the arena returns everything at once when the server dies.
+	// They live on the heap so a moved server's containers keep pointing at valid resources.
+	// The pool is synchronized so that batched ingest can grow different posting lists on
+	// different threads; each container is still modified from one thread at a time.
+	struct IndexMemory
+	{
+		std::pmr::monotonic_buffer_resource arena{64 * 1024};
+		std::pmr::synchronized_pool_resource pool{std::pmr::pool_options{0, 64 * 1024}, &arena};
+
+		CountingMemoryResource term_dictionary{&pool};
+		CountingMemoryResource postings{&pool};
+		CountingMemoryResource documents{&pool};
+		CountingMemoryResource document_ids{&pool};
+		CountingMemoryResource stop_words{&pool};
+	};
+
+	std::unique_ptr<IndexMemory> memory_ = std::make_unique<IndexMemory>();
+
+	// Runs the plus words of a search on thread_count SearchThreadPool workers.
+	struct PooledPolicy
+	{
+		size_t thread_count;
+	};
+
+	// Caller vector the results are appended to, instead of a new vector; size counts them.
+	struct DocumentAppender
+	{
+		std::vector<Document>* documents;
+		size_t size = 0;
 	};
 
-	std::set<std::string, std::less<>> stop_words_;
-	std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-	std::map<int, DocumentData> documents_;
-	std::set<int> document_ids_;
+	std::pmr::set<std::pmr::string, std::less<>> stop_words_{&memory_->stop_words};
+	std::pmr::map<std::string_view, std::pmr::map<int, double>> word_to_document_freqs_{&memory_->postings};
+	std::pmr::map<int, DocumentData> documents_{&memory_->documents};
+	std::pmr::set<int> document_ids_{&memory_->document_ids};
+	// Hash access to the postings of an interned word, so ingest skips the ordered lookups.
+	std::pmr::unordered_map<std::string_view, std::pmr::map<int, double>*> word_postings_{&memory_->postings};
+	size_t total_document_length_ = 0;
 
-	std::set<std::string> unique_words;
+	TermDictionary terms_{&memory_->term_dictionary};
 
-	std::string_view AddUniqueWord(const std::string& word);
+	DuplicateHandling duplicate_handling_ = DuplicateHandling::IGNORE;
+	double fuzzy_penalty_ = 0.5;
+	std::unordered_map<DocumentFingerprint, std::vector<std::set<int>>, DocumentFingerprintHasher> fingerprint_to_ids_;
+	std::set<int> duplicate_ids_;
+
+	PositionalIndex positional_index_;
+
+	std::shared_ptr<const ImpactIndex> impact_index_;
+
+	std::set<int>* FindDuplicateGroup(const DocumentFingerprint& fingerprint, const std::pmr::unordered_set<std::string_view>& words);
+	void RegisterFingerprint(int document_id, const DocumentFingerprint& fingerprint, const std::pmr::unordered_set<std::string_view>& words);
+	void UnregisterFingerprint(int document_id);
+
+	template<typename Policy>
+	void RemoveDocumentsImpl(Policy policy, const std::vector<int>& document_ids);
+
+	template<typename Policy>
+	std::vector<int> AddPreparedDocumentsImpl(Policy policy, const std::vector<PreparedDocument>& documents, std::vector<TermPostings>& postings);
+
+	// Drops a stale impact snapshot, counting it in "index.impact.invalidated".
+	void InvalidateImpactIndex();
+
+	// The checks AddPreparedDocument makes before touching the index; throws invalid_argument.
+	DocumentFingerprint CheckPreparedDocument(const PreparedDocument& document);
+	// Everything about an added document but its postings; words and word_positions view interned terms.
+	void RegisterDocument(const PreparedDocument& document, std::pmr::unordered_set<std::string_view> words,
+						  std::vector<std::pair<std::string_view, uint32_t>> word_positions, const DocumentFingerprint& fingerprint);
+
+	std::string_view AddUniqueWord(const std::string_view word);
 
 	bool IsStopWord(const std::string_view word) const;
 
+	// ParseQuery with plus and minus words sorted and deduplicated, as searches use it.
+	Query ParseSearchQuery(const std::string_view raw_query) const;
+	std::vector<std::string> FindQueryStopWords(const std::string_view raw_query) const;
+
 	std::deque<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
 
 	static int ComputeAverageRating(const std::vector<int>& ratings);
@@ -103,17 +383,67 @@ private:
 
 	Query ParseQuery(const std::string_view text) const;
 
+	Phrase ParsePhrase(const std::string_view text) const;
+
+	// Every indexed word starting with prefix; the first MAX_PREFIX_EXPANSION of them, in no
+	// particular order, are the ones in the most documents.
+	std::vector<std::string_view> ExpandPrefix(const std::string_view prefix) const;
+
+	void ExpandFuzzy(const std::string_view word, int max_distance, std::unordered_map<std::string_view, double>& word_weights) const;
+
+	std::vector<int> FindPhraseMatches(const Query& query) const;
+
 	static bool IsValidWord(const std::string_view word);
 
 	void CheckIsValidDocument(int document_id) const;
 
-	double ComputeWordInverseDocumentFreq(const std::string& word) const;
-
 	template<typename T>
 	std::vector<Document> FindAllDocuments(const Query& query, T predicate) const;
 	template<typename T, typename Policy>
 	std::vector<Document> FindAllDocuments(Policy policy, const Query& query, T predicate) const;
+	template<typename T, typename Policy, typename Ranking>
+	std::vector<Document> FindAllDocuments(Policy policy, const Query& query, T predicate, const SearchOptions& options, const Ranking& ranking) const;
+	template<typename T, typename Policy, typename Ranking, typename Trace>
+	std::vector<Document> FindAllDocuments(Policy policy, const Query& query, T predicate, const SearchOptions& options, const Ranking& ranking, Trace& trace) const;
+	// Output is a std::vector<Document> or a DocumentAppender.
+	template<typename T, typename Policy, typename Ranking, typename Trace, typename Output>
+	void FindAllDocuments(Policy policy, const Query& query, T predicate, const SearchOptions& options, const Ranking& ranking, Trace& trace, Output& output) const;
 	std::vector<Document> FindAllDocuments(const Query& query, DocumentStatus document_status) const;
+	template<typename T, typename Ranking, typename Trace, typename Output>
+	void FindAllDocumentsMatchingAll(const Query& query, T predicate, const SearchOptions& options, const Ranking& ranking, Trace& trace, Output& output) const;
+	// Ids of the documents that contain every one of words, ascending.
+	std::vector<int> IntersectPostings(const std::deque<std::string_view>& words, size_t& postings_read) const;
+	template<typename T, typename Trace, typename Output>
+	void FindTopDocumentsByImpact(const Query& query, T predicate, const SearchOptions& options, Trace& trace, Output& output) const;
+	template<typename RelevanceMap, typename Trace, typename Output>
+	void CollectMatchedDocuments(const Query& query, RelevanceMap& doc_to_rel, const SearchOptions& options, Trace& trace, Output& output) const;
+};
+
+// Opaque position in a ranked result list; a search with it returns only the documents ranked after it.
+struct SearchCursor
+{
+	double relevance = 0;
+	int rating = 0;
+	int id = 0;
+
+	static SearchCursor After(const Document& document)
+	{
+		return {document.relevance, document.rating, document.id};
+	}
+};
+
+struct SearchOptions
+{
+	size_t offset = 0;
+	size_t limit = SearchServer::MAX_RESULT_DOCUMENT_COUNT;
+	std::optional<SearchCursor> search_after;
+	// With ALL, a "prefix*" or "word~N" word is matched by any one of its expansions.
+	MatchMode match_mode = MatchMode::ANY;
+
+	size_t GetSelectionSize() const
+	{
+		return limit > std::numeric_limits<size_t>::max() - offset ? std::numeric_limits<size_t>::max() : offset + limit;
+	}
 };
 
 template<typename T>
@@ -130,7 +460,7 @@ SearchServer::SearchServer(T container)
 
 		if(!item.empty())
 		{
-			stop_words_.insert(item);
+			stop_words_.emplace(item);
 		}
 	}
 }
@@ -144,25 +474,110 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_
 template<typename T, typename Policy>
 std::vector<Document> SearchServer::FindTopDocuments(Policy policy, const std::string_view raw_query, T predicate) const
 {
-	Query query = ParseQuery(raw_query);
+	return FindTopDocuments(policy, raw_query, predicate, SearchOptions{});
+}
 
-	std::sort(query.plus_words.begin(), query.plus_words.end()); 
-	auto last_plus = std::unique(query.plus_words.begin(), query.plus_words.end());
-	query.plus_words.erase(last_plus, query.plus_words.end());
+template<typename T, typename Policy>
+std::vector<Document> SearchServer::FindTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options) const
+{
+	return FindTopDocuments(policy, raw_query, predicate, options, TfIdfRanking{});
+}
 
-	std::sort(query.minus_words.begin(), query.minus_words.end()); 
-	auto last_minus = std::unique(query.minus_words.begin(), query.minus_words.end());
-	query.minus_words.erase(last_minus, query.minus_words.end());
+template<typename T, typename Policy, typename Ranking>
+std::vector<Document> SearchServer::FindTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options, const Ranking& ranking) const
+{
+	return FindAllDocuments(policy, ParseSearchQuery(raw_query), predicate, options, ranking);
+}
 
-	std::vector<Document> matched_documents;
+template<typename T, typename Policy>
+size_t SearchServer::AppendTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options, std::vector<Document>& output) const
+{
+	QueryTrace<false> trace;
+	DocumentAppender appender{&output};
+	FindAllDocuments(policy, ParseSearchQuery(raw_query), predicate, options, TfIdfRanking{}, trace, appender);
+	return appender.size;
+}
 
-	matched_documents = FindAllDocuments(policy, query, predicate);
+template<typename T, typename Policy, typename Ranking, typename Trace>
+std::vector<Document> SearchServer::FindTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options, const Ranking& ranking, Trace& trace) const
+{
+	Query query;
 
-	if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT)
 	{
-		matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+		auto stage = trace.Stage("parse");
+		query = ParseSearchQuery(raw_query);
 	}
-	return matched_documents;
+
+	return FindAllDocuments(policy, query, predicate, options, ranking, trace);
+}
+
+template<typename T, typename Policy, typename Ranking>
+std::tuple<std::vector<Document>, QueryExplanation> SearchServer::ExplainTopDocuments(Policy policy, const std::string_view raw_query, T predicate, const SearchOptions& options, const Ranking& ranking) const
+{
+	QueryTrace<true> trace;
+	Query query;
+
+	{
+		auto stage = trace.Stage("parse");
+		query = ParseSearchQuery(raw_query);
+	}
+
+	QueryExplanation& explanation = trace.GetExplanation();
+	const CorpusStatistics corpus = GetCorpusStatistics();
+
+	const auto explain_terms = [&](const std::deque<std::string_view>& words, std::vector<QueryExplanation::Term>& terms)
+	{
+		for (const auto word : words)
+		{
+			QueryExplanation::Term term{std::string(word), 0, 0, query.GetWordWeight(word)};
+			const auto postings = word_to_document_freqs_.find(word);
+
+			if (postings != word_to_document_freqs_.end() && !postings->second.empty())
+			{
+				term.posting_length = postings->second.size();
+				term.inverse_document_freq = ranking.PrepareTerm(corpus, term.posting_length).inverse_document_freq;
+			}
+
+			terms.push_back(std::move(term));
+		}
+	};
+
+	explain_terms(query.plus_words, explanation.plus_terms);
+	explain_terms(query.minus_words, explanation.minus_terms);
+	explanation.stop_words = FindQueryStopWords(raw_query);
+	explanation.phrase_count = query.phrases.size();
+
+	std::vector<Document> documents = FindAllDocuments(policy, query, predicate, options, ranking, trace);
+	return {std::move(documents), trace.TakeExplanation()};
+}
+
+template<typename T, typename Policy>
+std::tuple<std::vector<Document>, QueryExplanation> SearchServer::ExplainTopDocuments(Policy policy, const std::string_view raw_query, T predicate) const
+{
+	return ExplainTopDocuments(policy, raw_query, predicate, SearchOptions{}, TfIdfRanking{});
+}
+
+template<typename T>
+auto SearchServer::PaginateTopDocuments(const std::string_view raw_query, size_t page_size, T predicate) const
+{
+	return LazyPaginator<Document, std::function<std::vector<Document>(const Document*, size_t)>>(page_size,
+		[this, query = std::string(raw_query), predicate](const Document* last, size_t size)
+		{
+			SearchOptions options;
+			options.limit = size;
+
+			if (last != nullptr)
+			{
+				options.search_after = SearchCursor::After(*last);
+			}
+
+			return FindTopDocuments(std::execution::seq, query, predicate, options);
+		});
+}
+
+inline auto SearchServer::PaginateTopDocuments(const std::string_view raw_query, size_t page_size) const
+{
+	return PaginateTopDocuments(raw_query, page_size, [](int document_id, DocumentStatus status, int rating) { return status == DocumentStatus::ACTUAL; });
 }
 
 template<typename Policy>
@@ -186,57 +601,490 @@ std::vector<Document> SearchServer::FindAllDocuments(const Query& query, T predi
 template<typename T, typename Policy>
 std::vector<Document> SearchServer::FindAllDocuments(Policy policy, const Query& query, T predicate) const
 {
-	ConcurrentMap<int, double> document_to_relevance(documents_.size());
+	SearchOptions all_documents;
+	all_documents.limit = std::numeric_limits<size_t>::max();
+
+	return FindAllDocuments(policy, query, predicate, all_documents, TfIdfRanking{});
+}
+
+template<typename T, typename Policy, typename Ranking>
+std::vector<Document> SearchServer::FindAllDocuments(Policy policy, const Query& query, T predicate, const SearchOptions& options, const Ranking& ranking) const
+{
+	QueryTrace<false> trace;
+	return FindAllDocuments(policy, query, predicate, options, ranking, trace);
+}
+
+template<typename T, typename Policy, typename Ranking, typename Trace>
+std::vector<Document> SearchServer::FindAllDocuments(Policy policy, const Query& query, T predicate, const SearchOptions& options, const Ranking& ranking, Trace& trace) const
+{
+	std::vector<Document> documents;
+	FindAllDocuments(policy, query, predicate, options, ranking, trace, documents);
+	return documents;
+}
+
+template<typename T, typename Policy, typename Ranking, typename Trace, typename Output>
+void SearchServer::FindAllDocuments(Policy policy, const Query& query, T predicate, const SearchOptions& options, const Ranking& ranking, Trace& trace, Output& output) const
+{
+	if (options.match_mode == MatchMode::ALL)
+	{
+		return FindAllDocumentsMatchingAll(query, predicate, options, ranking, trace, output);
+	}
 
-	std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](auto word)
+	if constexpr (std::is_same_v<Ranking, TfIdfRanking>)
 	{
-		if(word_to_document_freqs_.count(word))
+		// Quantized scores can't place documents relative to a cursor or weigh fuzzy matches.
+		if (impact_index_ && query.phrases.empty() && query.plus_word_weights.empty() && !options.search_after
+			&& options.GetSelectionSize() < documents_.size())
 		{
-			const double inverse_document_freq = ComputeWordInverseDocumentFreq(std::string(word));
+			return FindTopDocumentsByImpact(query, predicate, options, trace, output);
+		}
+	}
+
+	if constexpr (std::is_same_v<std::decay_t<Policy>, AdaptivePolicy>)
+	{
+		size_t posting_count = 0;
+
+		for (const auto word : query.plus_words)
+		{
+			const auto postings = word_to_document_freqs_.find(word);
+			posting_count += postings == word_to_document_freqs_.end() ? 0 : postings->second.size();
+		}
+
+		// Words are the unit of parallel work, so there is no use for more threads than words.
+		const size_t thread_count = std::min(policy.SelectThreadCount(posting_count), query.plus_words.size());
+		RECORD_VALUE("query.threads", thread_count);
+
+		if (thread_count <= 1)
+		{
+			return FindAllDocuments(std::execution::seq, query, predicate, options, ranking, trace, output);
+		}
 
-			for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(std::string(word)))
+		return FindAllDocuments(PooledPolicy{thread_count}, query, predicate, options, ranking, trace, output);
+	}
+
+	const CorpusStatistics corpus = GetCorpusStatistics();
+
+	if constexpr (std::is_same_v<std::decay_t<Policy>, std::execution::sequenced_policy>)
+	{
+		ScratchLease lease;
+		auto& document_to_relevance = lease.Get().document_to_relevance;
+
+		{
+			RECORD_DURATION("query.postings");
+			auto stage = trace.Stage("postings");
+
+			for (const auto word : query.plus_words)
 			{
-				if (predicate(document_id, documents_.at(document_id).status, documents_.at(document_id).rating))
+				const auto postings = word_to_document_freqs_.find(word);
+
+				if (postings == word_to_document_freqs_.end())
 				{
-					document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+					continue;
+				}
+
+				const auto score = ranking.PrepareTerm(corpus, postings->second.size());
+				const double weight = query.GetWordWeight(word);
+				trace.OnPostings(postings->second.size());
+
+				for (const auto& [document_id, term_freq] : postings->second)
+				{
+					const DocumentData& data = documents_.at(document_id);
+
+					if (predicate(document_id, data.status, data.rating))
+					{
+						document_to_relevance[document_id] += score(term_freq, data) * weight;
+					}
+					else
+					{
+						trace.OnPredicateRejected(document_id);
+					}
 				}
 			}
 		}
-	});
 
-	std::map<int, double> doc_to_rel = document_to_relevance.BuildOrdinaryMap();
+		return CollectMatchedDocuments(query, document_to_relevance, options, trace, output);
+	}
+	else if constexpr (!std::is_same_v<std::decay_t<Policy>, AdaptivePolicy>)
+	{
+		ConcurrentMap<int, double> document_to_relevance(documents_.size());
+		std::map<int, double> doc_to_rel;
+
+		{
+			RECORD_DURATION("query.postings");
+			auto stage = trace.Stage("postings");
+
+			const auto add_postings = [&](auto word)
+			{
+				const auto postings = word_to_document_freqs_.find(word);
+
+				if (postings != word_to_document_freqs_.end())
+				{
+					const auto score = ranking.PrepareTerm(corpus, postings->second.size());
+					const double weight = query.GetWordWeight(word);
+					trace.OnPostings(postings->second.size());
+
+					for (const auto& [document_id, term_freq] : postings->second)
+					{
+						const DocumentData& data = documents_.at(document_id);
+
+						if (predicate(document_id, data.status, data.rating))
+						{
+							document_to_relevance[document_id].ref_to_value += score(term_freq, data) * weight;
+						}
+						else
+						{
+							trace.OnPredicateRejected(document_id);
+						}
+					}
+				}
+			};
+
+			if constexpr (std::is_same_v<std::decay_t<Policy>, PooledPolicy>)
+			{
+				// Every worker takes the next unclaimed word, so one long posting list doesn't
+				// hold up a fixed share of the others.
+				std::atomic<size_t> next_word{0};
+
+				SearchThreadPool::Shared().ParallelFor(policy.thread_count, [&](size_t)
+				{
+					for (size_t i = next_word++; i < query.plus_words.size(); i = next_word++)
+					{
+						add_postings(query.plus_words[i]);
+					}
+				});
+			}
+			else
+			{
+				std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), add_postings);
+			}
+
+			doc_to_rel = document_to_relevance.BuildOrdinaryMap();
+		}
+
+		return CollectMatchedDocuments(query, doc_to_rel, options, trace, output);
+	}
+}
+
+// Conjunctive queries keep few documents, so they run sequentially under any policy: the
+// intersection reads a fraction of the postings and only its survivors are scored.
+template<typename T, typename Ranking, typename Trace, typename Output>
+void SearchServer::FindAllDocumentsMatchingAll(const Query& query, T predicate, const SearchOptions& options, const Ranking& ranking, Trace& trace, Output& output) const
+{
+	const CorpusStatistics corpus = GetCorpusStatistics();
+	ScratchLease lease;
+	auto& document_to_relevance = lease.Get().document_to_relevance;
 
-	for (const auto word : query.minus_words)
 	{
-		if (word_to_document_freqs_.count(std::string(word)) == 0)
+		RECORD_DURATION("query.postings");
+		auto stage = trace.Stage("postings");
+
+		size_t postings_read = 0;
+		std::vector<int> document_ids;
+		auto alternative_begin = query.alternatives.begin();
+
+		if (!query.required_words.empty())
 		{
-			continue;
+			document_ids = IntersectPostings(query.required_words, postings_read);
 		}
-		for (const auto& [document_id, _] : word_to_document_freqs_.at(std::string(word)))
+		else if (!query.alternatives.empty())
 		{
-			doc_to_rel.erase(document_id);
+			// Nothing is required by name, so the first expansion's documents are the candidates.
+			for (const auto word : *alternative_begin)
+			{
+				const auto& postings = word_to_document_freqs_.at(word);
+				postings_read += postings.size();
+
+				for (const auto& [document_id, _] : postings)
+				{
+					document_ids.push_back(document_id);
+				}
+			}
+
+			std::sort(document_ids.begin(), document_ids.end());
+			document_ids.erase(std::unique(document_ids.begin(), document_ids.end()), document_ids.end());
+			++alternative_begin;
+		}
+
+		for (auto alternative = alternative_begin; alternative != query.alternatives.end() && !document_ids.empty(); ++alternative)
+		{
+			const auto has_any_word = [this, &alternative](int document_id)
+			{
+				return std::any_of(alternative->begin(), alternative->end(), [this, document_id](std::string_view word)
+				{
+					const auto& postings = word_to_document_freqs_.at(word);
+					return postings.count(document_id) != 0;
+				});
+			};
+
+			document_ids.erase(std::remove_if(document_ids.begin(), document_ids.end(), [&has_any_word](int document_id) { return !has_any_word(document_id); }),
+				document_ids.end());
 		}
+
+		using TermScorer = decltype(ranking.PrepareTerm(corpus, size_t{1}));
+		std::vector<std::tuple<const std::pmr::map<int, double>*, TermScorer, double>> terms;
+
+		for (const auto word : query.plus_words)
+		{
+			const auto postings = word_to_document_freqs_.find(word);
+
+			if (postings != word_to_document_freqs_.end() && !postings->second.empty())
+			{
+				terms.emplace_back(&postings->second, ranking.PrepareTerm(corpus, postings->second.size()), query.GetWordWeight(word));
+			}
+		}
+
+		// Same arithmetic in the same order as the disjunctive path, so relevances match it exactly.
+		for (const int document_id : document_ids)
+		{
+			const DocumentData& data = documents_.at(document_id);
+
+			if (!predicate(document_id, data.status, data.rating))
+			{
+				trace.OnPredicateRejected(document_id);
+				continue;
+			}
+
+			double& relevance = document_to_relevance[document_id];
+
+			for (const auto& [postings, score, weight] : terms)
+			{
+				const auto term_freq = postings->find(document_id);
+
+				if (term_freq != postings->end())
+				{
+					relevance += score(term_freq->second, data) * weight;
+				}
+			}
+		}
+
+		trace.OnPostings(postings_read);
 	}
-	
-	std::vector<Document> matched_documents;
-	matched_documents.reserve(doc_to_rel.size());
-	
-	for (const auto& [document_id, relevance] : doc_to_rel)
+
+	return CollectMatchedDocuments(query, document_to_relevance, options, trace, output);
+}
+
+template<typename T, typename Trace, typename Output>
+void SearchServer::FindTopDocumentsByImpact(const Query& query, T predicate, const SearchOptions& options, Trace& trace, Output& output) const
+{
+	// Exact scores are within query.plus_words.size() / 2 steps of the quantized ones, so a
+	// document further than that many steps behind the k-th can't reach the top; ties up
+	// to EPSILON (same rounded multiple) are broken by rating, which widens the margin by EPSILON.
+	const uint64_t margin = query.plus_words.size() + static_cast<uint64_t>(std::ceil(EPSILON / impact_index_->GetScale())) + 1;
+	const bool is_impact_ordered = impact_index_->GetLayout() == ImpactLayout::IMPACT_ORDERED;
+
+	ImpactIndex::Accumulation accumulation;
+	std::vector<uint32_t> slots;
+	std::vector<uint32_t> scores;
+
 	{
-		matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+		RECORD_DURATION("query.postings");
+		auto stage = trace.Stage("postings");
+
+		if (is_impact_ordered)
+		{
+			impact_index_->AccumulateTop(query.plus_words, query.minus_words, options.GetSelectionSize(), static_cast<uint32_t>(std::min<uint64_t>(margin, UINT32_MAX)),
+				[&predicate, &trace](const ImpactIndex::SlotDocument& document)
+				{
+					const bool is_accepted = predicate(document.id, document.status, document.rating);
+
+					if (!is_accepted)
+					{
+						trace.OnPredicateRejected(document.id);
+					}
+
+					return is_accepted;
+				}, accumulation);
+
+			slots = std::move(accumulation.slots);
+			scores = std::move(accumulation.scores);
+		}
+		else
+		{
+			impact_index_->Accumulate(query.plus_words, query.minus_words, accumulation);
+		}
 	}
 
-	sort(matched_documents.begin(), matched_documents.end(), [this, predicate](const Document &lhs, const Document &rhs)
+	ScratchLease lease;
+	auto& document_to_relevance = lease.Get().document_to_relevance;
+
 	{
-		if (std::abs(lhs.relevance - rhs.relevance) < EPSILON)
+		RECORD_DURATION("query.impact.rescore");
+		auto stage = trace.Stage("impact.rescore");
+
+		if (!is_impact_ordered)
 		{
-			return lhs.rating > rhs.rating;
+			slots.reserve(accumulation.slots.size());
+			scores.reserve(accumulation.slots.size());
+
+			for (size_t i = 0; i < accumulation.slots.size(); ++i)
+			{
+				const auto& document = impact_index_->GetDocument(accumulation.slots[i]);
+
+				if (predicate(document.id, document.status, document.rating))
+				{
+					slots.push_back(accumulation.slots[i]);
+					scores.push_back(accumulation.scores[i]);
+				}
+				else
+				{
+					trace.OnPredicateRejected(document.id);
+				}
+			}
+		}
+
+		trace.OnPostings(accumulation.postings_read);
+		trace.OnImpactIndex(slots.size());
+
+		const size_t top_count = std::min(scores.size(), options.GetSelectionSize());
+
+		if (top_count == 0)
+		{
+			trace.OnResults(0);
+			return;
+		}
+
+		std::vector<uint32_t> positions;
+
+		if (is_impact_ordered)
+		{
+			// The scores are partial; AccumulateTop kept only the documents worth rescoring.
+			positions.resize(slots.size());
+			std::iota(positions.begin(), positions.end(), 0);
 		}
 		else
 		{
-			return lhs.relevance > rhs.relevance;
-		} 
-	});
+			std::vector<uint32_t> kth_scores(scores);
+			std::nth_element(kth_scores.begin(), kth_scores.begin() + (top_count - 1), kth_scores.end(), std::greater<>());
+
+			const uint64_t kth_score = kth_scores[top_count - 1];
+			const uint32_t cutoff = kth_score > margin ? static_cast<uint32_t>(kth_score - margin) : 0;
+			positions = ImpactIndex::SelectAtLeast(scores, cutoff);
+		}
+
+		const CorpusStatistics corpus = GetCorpusStatistics();
+
+		// Same arithmetic in the same order as the double path, so relevances match it exactly.
+		for (const uint32_t position : positions)
+		{
+			const int document_id = impact_index_->GetDocument(slots[position]).id;
+			double relevance = 0;
+
+			for (const auto word : query.plus_words)
+			{
+				const auto postings = word_to_document_freqs_.find(word);
+
+				if (postings == word_to_document_freqs_.end())
+				{
+					continue;
+				}
+
+				const auto term_freq = postings->second.find(document_id);
+
+				if (term_freq != postings->second.end())
+				{
+					relevance += TfIdfRanking{}.PrepareTerm(corpus, postings->second.size())(term_freq->second, documents_.at(document_id)) * 1.0;
+				}
+			}
+
+			document_to_relevance.emplace(document_id, relevance);
+		}
+	}
+
+	return CollectMatchedDocuments(query, document_to_relevance, options, trace, output);
+}
+
+template<typename RelevanceMap, typename Trace, typename Output>
+void SearchServer::CollectMatchedDocuments(const Query& query, RelevanceMap& doc_to_rel, const SearchOptions& options, Trace& trace, Output& output) const
+{
+	trace.OnCandidates(doc_to_rel.size());
+
+	{
+		RECORD_DURATION("query.minus");
+		auto stage = trace.Stage("minus");
+
+		for (const auto word : query.minus_words)
+		{
+			const auto postings = word_to_document_freqs_.find(word);
+
+			if (postings == word_to_document_freqs_.end())
+			{
+				continue;
+			}
+
+			trace.OnPostings(postings->second.size());
+
+			for (const auto& [document_id, _] : postings->second)
+			{
+				trace.OnRemovedByMinus(doc_to_rel.erase(document_id));
+			}
+		}
+	}
+
+	if (!query.phrases.empty())
+	{
+		RECORD_DURATION("query.phrase");
+		auto stage = trace.Stage("phrase");
+
+		const std::vector<int> phrase_matches = FindPhraseMatches(query);
+
+		for (auto it = doc_to_rel.begin(); it != doc_to_rel.end();)
+		{
+			if (std::binary_search(phrase_matches.begin(), phrase_matches.end(), it->first))
+			{
+				++it;
+			}
+			else
+			{
+				it = doc_to_rel.erase(it);
+				trace.OnRemovedByPhrase(1);
+			}
+		}
+	}
+
+	RECORD_DURATION("query.sort");
+	auto stage = trace.Stage("sort");
+
+	// A vector output is built in place; an appender is filled from a buffer reused per thread.
+	thread_local std::vector<Document> appender_candidates;
+	std::vector<Document>* candidates = &appender_candidates;
+
+	if constexpr (std::is_same_v<Output, std::vector<Document>>)
+	{
+		candidates = &output;
+	}
+
+	std::vector<Document>& matched_documents = *candidates;
+	matched_documents.clear();
+	matched_documents.reserve(doc_to_rel.size());
+
+	for (const auto& [document_id, relevance] : doc_to_rel)
+	{
+		const Document document(document_id, relevance, documents_.at(document_id).rating);
+
+		if (options.search_after && !IsRankedBefore(Document(options.search_after->id, options.search_after->relevance, options.search_after->rating), document))
+		{
+			trace.OnRemovedByCursor(1);
+			continue;
+		}
+
+		matched_documents.push_back(document);
+	}
+
+	// Only the first offset + limit positions are ordered; the tail is dropped unsorted.
+	const size_t selection_size = std::min(matched_documents.size(), options.GetSelectionSize());
+	const size_t skipped = std::min(options.offset, selection_size);
+	std::partial_sort(matched_documents.begin(), matched_documents.begin() + selection_size, matched_documents.end(), IsRankedBefore);
+
+	if constexpr (std::is_same_v<Output, DocumentAppender>)
+	{
+		output.documents->insert(output.documents->end(), matched_documents.begin() + skipped, matched_documents.begin() + selection_size);
+		output.size = selection_size - skipped;
+	}
+	else
+	{
+		matched_documents.resize(selection_size);
+		matched_documents.erase(matched_documents.begin(), matched_documents.begin() + skipped);
+	}
 
-	return matched_documents;
+	trace.OnResults(selection_size - skipped);
 }
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include "search_thread_pool.h"
+
+namespace
+{
+	thread_local const SearchThreadPool* current_pool = nullptr;
+	thread_local size_t current_worker = 0;
+}
+
+SearchThreadPool::SearchThreadPool(size_t thread_count)
+{
+	thread_count = std::max<size_t>(thread_count, 1);
+
+	for(size_t i = 0; i < thread_count; ++i)
+	{
+		queues_.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	threads_.reserve(thread_count);
+
+	for(size_t i = 0; i < thread_count; ++i)
+	{
+		threads_.emplace_back([this, i] { WorkerLoop(i); });
+	}
+}
+
+SearchThreadPool::~SearchThreadPool()
+{
+	{
+		const std::lock_guard<std::mutex> lock(sleep_mutex_);
+		stopping_ = true;
+	}
+
+	wake_.notify_all();
+
+	for(auto& thread : threads_)
+	{
+		thread.join();
+	}
+}
+
+size_t SearchThreadPool::GetThreadCount() const
+{
+	return threads_.size();
+}
+
+size_t SearchThreadPool::DefaultThreadCount()
+{
+	return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+SearchThreadPool& SearchThreadPool::Shared()
+{
+	static SearchThreadPool pool;
+	return pool;
+}
+
+void SearchThreadPool::Push(size_t queue_index, Task task)
+{
+	{
+		WorkerQueue& queue = *queues_[queue_index];
+		const std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	pending_.fetch_add(1, std::memory_order_release);
+
+	{
+		const std::lock_guard<std::mutex> lock(sleep_mutex_);
+	}
+
+	wake_.notify_one();
+}
+
+bool SearchThreadPool::TryRunTask(size_t home_queue)
+{
+	Task task;
+
+	for(size_t offset = 0; offset < queues_.size() && !task; ++offset)
+	{
+		WorkerQueue& queue = *queues_[(home_queue + offset) % queues_.size()];
+		const std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if(queue.tasks.empty())
+		{
+			continue;
+		}
+
+		// The owner works LIFO for cache locality, thieves take the oldest task.
+		if(offset == 0)
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+	}
+
+	if(!task)
+	{
+		return false;
+	}
+
+	pending_.fetch_sub(1, std::memory_order_acq_rel);
+	task();
+
+	return true;
+}
+
+size_t SearchThreadPool::HomeQueue() const
+{
+	return current_pool == this ? current_worker : 0;
+}
+
+void SearchThreadPool::WorkerLoop(size_t index)
+{
+	current_pool = this;
+	current_worker = index;
+
+	while(true)
+	{
+		if(TryRunTask(index))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex_);
+		wake_.wait(lock, [this] { return stopping_ || pending_.load(std::memory_order_acquire) > 0; });
+
+		if(stopping_ && pending_.load(std::memory_order_acquire) == 0)
+		{
+			return;
+		}
+	}
+}
+
+void SearchThreadPool::Wait(Batch& batch)
+{
+	const size_t home_queue = HomeQueue();
+
+	while(batch.remaining.load(std::memory_order_acquire) > 0)
+	{
+		if(TryRunTask(home_queue))
+		{
+			continue;
+		}
+
+		// Nothing left to steal: the remaining tasks of this batch are already running elsewhere.
+		std::unique_lock<std::mutex> lock(batch.mutex);
+		batch.done.wait(lock, [&batch] { return batch.remaining.load(std::memory_order_acquire) == 0; });
+	}
+
+	// The last task decrements and notifies under the batch mutex; taking it here guarantees that
+	// task has let go of the batch before the caller destroys it.
+	const std::lock_guard<std::mutex> lock(batch.mutex);
+}
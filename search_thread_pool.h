@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of search workers, each with its own task deque. A worker takes work from the back
+// of its own deque and steals from the front of the others, so a few expensive queries do not
+// leave the remaining workers idle. Threads waiting in ParallelFor execute tasks themselves,
+// which makes nested ParallelFor calls from inside a task safe.
+class SearchThreadPool
+{
+public:
+	explicit SearchThreadPool(size_t thread_count = DefaultThreadCount());
+	~SearchThreadPool();
+
+	SearchThreadPool(const SearchThreadPool&) = delete;
+	SearchThreadPool& operator=(const SearchThreadPool&) = delete;
+
+	size_t GetThreadCount() const;
+
+	// Calls function(i) for every i in [0, count) and returns when all calls have finished.
+	// The first exception thrown by a call is rethrown here.
+	template<typename Function>
+	void ParallelFor(size_t count, Function&& function);
+
+	static size_t DefaultThreadCount();
+
+	static SearchThreadPool& Shared();
+
+private:
+	using Task = std::function<void()>;
+
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	struct Batch
+	{
+		explicit Batch(size_t count) : remaining(count) {}
+
+		std::atomic<size_t> remaining;
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr error;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues_;
+	std::vector<std::thread> threads_;
+
+	std::atomic<size_t> pending_{0};
+	std::atomic<size_t> next_queue_{0};
+	std::mutex sleep_mutex_;
+	std::condition_variable wake_;
+	bool stopping_ = false;
+
+	void Push(size_t queue_index, Task task);
+	bool TryRunTask(size_t home_queue);
+	size_t HomeQueue() const;
+	void WorkerLoop(size_t index);
+	void Wait(Batch& batch);
+};
+
+template<typename Function>
+void SearchThreadPool::ParallelFor(size_t count, Function&& function)
+{
+	if(count == 0)
+	{
+		return;
+	}
+
+	Batch batch(count);
+	const size_t first_queue = next_queue_.fetch_add(1, std::memory_order_relaxed);
+
+	for(size_t i = 0; i < count; ++i)
+	{
+		Push((first_queue + i) % queues_.size(), [&batch, &function, i]
+		{
+			try
+			{
+				function(i);
+			}
+			catch(...)
+			{
+				const std::lock_guard<std::mutex> lock(batch.mutex);
+
+				if(!batch.error)
+				{
+					batch.error = std::current_exception();
+				}
+			}
+
+			const std::lock_guard<std::mutex> lock(batch.mutex);
+
+			if(batch.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				batch.done.notify_all();
+			}
+		});
+	}
+
+	Wait(batch);
+
+	if(batch.error)
+	{
+		std::rethrow_exception(batch.error);
+	}
+}
@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include "slow_query_log.h"
+
+namespace
+{
+	void AppendJsonString(std::ostream& out, std::string_view text)
+	{
+		out << '"';
+
+		for(const char c : text)
+		{
+			if(c == '"' || c == '\\')
+			{
+				out << '\\' << c;
+			}
+			else if(static_cast<unsigned char>(c) < ' ')
+			{
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+			}
+			else
+			{
+				out << c;
+			}
+		}
+
+		out << '"';
+	}
+
+	// Copies text into buffer with a terminating zero; false when it had to be cut.
+	template<size_t Size>
+	bool CopyTruncated(std::array<char, Size>& buffer, std::string_view text)
+	{
+		const size_t length = std::min(text.size(), Size - 1);
+		std::copy_n(text.begin(), length, buffer.begin());
+		buffer[length] = '\0';
+
+		return length == text.size();
+	}
+}
+
+size_t SlowQueryLog::Trace::GetStageIndex(std::string_view name)
+{
+	const auto& names = SlowQueryRecord::STAGE_NAMES;
+	return std::find(names.begin(), names.end(), name) - names.begin();
+}
+
+SlowQueryLog::SlowQueryLog(Clock::duration threshold, double sample_rate, size_t capacity)
+	: threshold_(threshold), sample_rate_(sample_rate)
+	, mask_([capacity]
+	{
+		if(capacity == 0)
+		{
+			throw std::invalid_argument("slow query log capacity must be positive");
+		}
+
+		size_t size = 1;
+
+		while(size < capacity)
+		{
+			size <<= 1;
+		}
+
+		return size - 1;
+	}())
+	, slots_(std::make_unique<Slot[]>(mask_ + 1))
+{
+	if(sample_rate < 0 || sample_rate > 1)
+	{
+		throw std::invalid_argument("slow query sample rate must be within [0, 1]");
+	}
+}
+
+bool SlowQueryLog::ShouldRecord(Clock::duration latency) const
+{
+	if(latency >= threshold_)
+	{
+		return true;
+	}
+
+	if(sample_rate_ <= 0)
+	{
+		return false;
+	}
+
+	thread_local std::minstd_rand generator(std::random_device{}());
+	return std::uniform_real_distribution<double>(0, 1)(generator) < sample_rate_;
+}
+
+void SlowQueryLog::Record(std::string_view query, std::string_view filter, size_t result_count, Clock::duration latency, const Trace& trace)
+{
+	const uint64_t ticket = next_ticket_.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = slots_[ticket & mask_];
+	uint64_t version = slot.version.load(std::memory_order_relaxed);
+
+	if((version & 1) != 0 || !slot.version.compare_exchange_strong(version, version + 1, std::memory_order_acquire))
+	{
+		dropped_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	SlowQueryRecord record;
+	record.sequence = ticket;
+	record.is_query_truncated = !CopyTruncated(record.query, query);
+	CopyTruncated(record.filter, filter);
+	record.is_sampled = latency < threshold_;
+	record.result_count = static_cast<uint32_t>(result_count);
+	record.postings_touched = trace.postings_touched_.load(std::memory_order_relaxed);
+	record.latency = std::chrono::duration_cast<std::chrono::nanoseconds>(latency);
+	record.stage_durations = trace.stage_durations_;
+
+	std::array<uint64_t, RECORD_WORD_COUNT> words{};
+	std::memcpy(words.data(), &record, sizeof(record));
+
+	// Readers that see any of the word stores below also see the odd version.
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for(size_t i = 0; i < RECORD_WORD_COUNT; ++i)
+	{
+		slot.words[i].store(words[i], std::memory_order_relaxed);
+	}
+
+	slot.version.store(version + 2, std::memory_order_release);
+}
+
+std::vector<SlowQueryRecord> SlowQueryLog::Snapshot() const
+{
+	std::vector<SlowQueryRecord> result;
+
+	for(size_t i = 0; i <= mask_; ++i)
+	{
+		const Slot& slot = slots_[i];
+		const uint64_t version = slot.version.load(std::memory_order_acquire);
+
+		if(version == 0 || (version & 1) != 0)
+		{
+			continue;
+		}
+
+		std::array<uint64_t, RECORD_WORD_COUNT> words;
+
+		for(size_t word = 0; word < RECORD_WORD_COUNT; ++word)
+		{
+			words[word] = slot.words[word].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// A writer took the slot while it was being copied.
+		if(slot.version.load(std::memory_order_relaxed) != version)
+		{
+			continue;
+		}
+
+		// SlowQueryRecord is trivially copyable; its member initializers only hide that from -Wclass-memaccess.
+		SlowQueryRecord record;
+		std::memcpy(static_cast<void*>(&record), words.data(), sizeof(record));
+		result.push_back(record);
+	}
+
+	std::sort(result.begin(), result.end(), [](const SlowQueryRecord& lhs, const SlowQueryRecord& rhs) { return lhs.sequence < rhs.sequence; });
+
+	return result;
+}
+
+void SlowQueryLog::DumpToFile(const std::string& path) const
+{
+	std::ofstream out(path);
+
+	if(!out)
+	{
+		throw std::runtime_error("can't open slow query log file " + path);
+	}
+
+	for(const auto& record : Snapshot())
+	{
+		out << "{\"sequence\":" << record.sequence << ",\"query\":";
+		AppendJsonString(out, record.GetQuery());
+		out << ",\"query_truncated\":" << (record.is_query_truncated ? "true" : "false") << ",\"filter\":";
+		AppendJsonString(out, record.GetFilter());
+		out << ",\"sampled\":" << (record.is_sampled ? "true" : "false") << ",\"results\":" << record.result_count
+			<< ",\"postings_touched\":" << record.postings_touched << ",\"latency_ns\":" << record.latency.count() << ",\"stages_ns\":{";
+
+		for(size_t stage = 0; stage < SlowQueryRecord::STAGE_COUNT; ++stage)
+		{
+			out << (stage == 0 ? "" : ",") << '"' << SlowQueryRecord::STAGE_NAMES[stage] << "\":" << record.stage_durations[stage].count();
+		}
+
+		out << "}}\n";
+	}
+
+	if(!out)
+	{
+		throw std::runtime_error("can't write slow query log file " + path);
+	}
+}
+
+uint64_t SlowQueryLog::GetRecordedCount() const
+{
+	return next_ticket_.load(std::memory_order_relaxed) - dropped_.load(std::memory_order_relaxed);
+}
+
+uint64_t SlowQueryLog::GetDroppedCount() const
+{
+	return dropped_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// One logged query. Fixed-size so the ring never allocates: a longer query or filter
+// is cut to fit and flagged as truncated.
+struct SlowQueryRecord
+{
+	inline static constexpr size_t MAX_QUERY_LENGTH = 255;
+	inline static constexpr size_t MAX_FILTER_LENGTH = 31;
+	inline static constexpr size_t STAGE_COUNT = 6;
+	// Stages as the search path names them, in the order stage_durations stores them.
+	inline static constexpr std::array<std::string_view, STAGE_COUNT> STAGE_NAMES = {"parse", "postings", "impact.rescore", "minus", "phrase", "sort"};
+
+	uint64_t sequence = 0;
+	std::array<char, MAX_QUERY_LENGTH + 1> query{};
+	std::array<char, MAX_FILTER_LENGTH + 1> filter{};
+	bool is_query_truncated = false;
+	// Below the threshold, logged by sampling.
+	bool is_sampled = false;
+	uint32_t result_count = 0;
+	uint64_t postings_touched = 0;
+	std::chrono::nanoseconds latency{0};
+	std::array<std::chrono::nanoseconds, STAGE_COUNT> stage_durations{};
+
+	std::string_view GetQuery() const { return query.data(); }
+	std::string_view GetFilter() const { return filter.data(); }
+};
+
+static_assert(std::is_trivially_copyable_v<SlowQueryRecord>, "slow query records are copied word by word");
+
+// Keeps the most recent queries that took at least threshold, plus a random sample_rate
+// share of the faster ones, in a fixed ring of capacity records. Any number of threads
+// record at once without locks: each claims a slot with a ticket and guards it with a
+// version that is odd while the record is written. A writer that finds its slot still
+// being written (the ring wrapped around under it) drops its record instead of waiting.
+class SlowQueryLog
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Stage timings and postings counts of one search, gathered through the QueryTrace hooks.
+	class Trace
+	{
+	public:
+		class StageTimer
+		{
+		public:
+			StageTimer(Trace& trace, size_t stage) : trace_(trace), stage_(stage) {}
+
+			StageTimer(const StageTimer&) = delete;
+			StageTimer& operator=(const StageTimer&) = delete;
+
+			~StageTimer()
+			{
+				if(stage_ < SlowQueryRecord::STAGE_COUNT)
+				{
+					trace_.stage_durations_[stage_] += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_);
+				}
+			}
+
+		private:
+			Trace& trace_;
+			const size_t stage_;
+			const Clock::time_point start_time_ = Clock::now();
+		};
+
+		StageTimer Stage(std::string_view name) { return StageTimer(*this, GetStageIndex(name)); }
+
+		void OnPostings(size_t count) { postings_touched_.fetch_add(count, std::memory_order_relaxed); }
+		void OnPredicateRejected(int) {}
+		void OnCandidates(size_t) {}
+		void OnRemovedByMinus(size_t) {}
+		void OnRemovedByPhrase(size_t) {}
+		void OnRemovedByCursor(size_t) {}
+		void OnResults(size_t) {}
+		void OnImpactIndex(size_t) {}
+
+	private:
+		friend class SlowQueryLog;
+
+		std::atomic<uint64_t> postings_touched_{0};
+		std::array<std::chrono::nanoseconds, SlowQueryRecord::STAGE_COUNT> stage_durations_{};
+
+		static size_t GetStageIndex(std::string_view name);
+	};
+
+	explicit SlowQueryLog(Clock::duration threshold, double sample_rate = 0, size_t capacity = 1024);
+
+	// Whether a query that took latency belongs in the log; samples the fast ones.
+	bool ShouldRecord(Clock::duration latency) const;
+
+	// Stores the query regardless of ShouldRecord; it counts as sampled below the threshold.
+	void Record(std::string_view query, std::string_view filter, size_t result_count, Clock::duration latency, const Trace& trace);
+
+	// The complete records currently in the ring, oldest first.
+	std::vector<SlowQueryRecord> Snapshot() const;
+
+	// Writes Snapshot() as one JSON object per line; throws std::runtime_error when the file can't be written.
+	void DumpToFile(const std::string& path) const;
+
+	uint64_t GetRecordedCount() const;
+	uint64_t GetDroppedCount() const;
+
+private:
+	// The record is kept as atomic words so a Snapshot racing with a writer reads torn but
+	// defined values, which the version check then discards (the usual seqlock layout).
+	inline static constexpr size_t RECORD_WORD_COUNT = (sizeof(SlowQueryRecord) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	struct Slot
+	{
+		std::atomic<uint64_t> version{0};
+		std::array<std::atomic<uint64_t>, RECORD_WORD_COUNT> words{};
+	};
+
+	const Clock::duration threshold_;
+	const double sample_rate_;
+	const size_t mask_;
+	std::unique_ptr<Slot[]> slots_;
+	std::atomic<uint64_t> next_ticket_{0};
+	std::atomic<uint64_t> dropped_{0};
+};
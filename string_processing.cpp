@@ -8,24 +8,27 @@ std::vector<std::string_view> SplitIntoWords(std::string_view text)
 {
 	std::vector<std::string_view> words;
 
-	auto start = text.begin();
-	auto end = text.end();
-	auto next = std::find( start, end, ' ');
-	
-	while ( next != end ) 
+	// Runs of spaces separate words; the view is never read past its end, so it needs no terminator.
+	while(true)
 	{
-		if(*(next + 1) != ' ')
+		const size_t start = text.find_first_not_of(' ');
+
+		if(start == std::string_view::npos)
 		{
-			words.push_back(std::string_view(start, next - start));
+			break;
 		}
-		
-		start = next + 1;
-		next = std::find( start, end, ' ');
-	}
 
-	if(*start != 0)
-	{
-		words.push_back(std::string_view(start, next - start));
+		text.remove_prefix(start);
+
+		const size_t end = text.find(' ');
+		words.push_back(text.substr(0, end));
+
+		if(end == std::string_view::npos)
+		{
+			break;
+		}
+
+		text.remove_prefix(end);
 	}
 
 	return words;
@@ -33,27 +36,7 @@ std::vector<std::string_view> SplitIntoWords(std::string_view text)
 
 std::unordered_set<std::string_view> SplitIntoUniqueWords(std::string_view text)
 {
-	std::unordered_set<std::string_view> words;
+	const std::vector<std::string_view> words = SplitIntoWords(text);
 
-	auto start = text.begin();
-	auto end = text.end();
-	auto next = std::find( start, end, ' ');
-	
-	while ( next != end ) 
-	{
-		if(*(next + 1) != ' ')
-		{
-			words.insert(std::string_view(start, next - start));
-		}
-		
-		start = next + 1;
-		next = std::find( start, end, ' ');
-	}
-
-	if(*start != 0)
-	{
-		words.insert(std::string_view(start, next - start));
-	}
-	
-	return words;
-}
\ No newline at end of file
+	return std::unordered_set<std::string_view>(words.begin(), words.end());
+}
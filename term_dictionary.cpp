@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <vector>
+#include "term_dictionary.h"
+
+TermDictionary::TermDictionary(std::pmr::memory_resource* resource)
+	: terms_(resource)
+{
+}
+
+std::string_view TermDictionary::Intern(std::string_view word)
+{
+	// Look up first so words that are already known don't build a temporary string.
+	auto it = terms_.find(word);
+
+	if(it == terms_.end())
+	{
+		it = terms_.emplace(word).first;
+	}
+
+	return *it;
+}
+
+bool TermDictionary::Contains(std::string_view word) const
+{
+	return terms_.find(word) != terms_.end();
+}
+
+size_t TermDictionary::GetSize() const
+{
+	return terms_.size();
+}
+
+void TermDictionary::ForEachWithinDistance(std::string_view word, int max_distance, const std::function<void(std::string_view, int)>& fn) const
+{
+	const size_t width = word.size() + 1;
+
+	// rows holds one edit distance row per prefix length: rows[d * width + i] is the
+	// distance between the first d characters of prefix and the first i of word.
+	std::vector<int> rows(width);
+	std::string prefix;
+
+	for(size_t i = 0; i < width; ++i)
+	{
+		rows[i] = static_cast<int>(i);
+	}
+
+	// Appends c to prefix and its row to rows; false when no extension of prefix can match.
+	const auto push = [&](char c)
+	{
+		rows.resize(rows.size() + width);
+		const int* previous = &rows[prefix.size() * width];
+		int* current = &rows[(prefix.size() + 1) * width];
+		prefix.push_back(c);
+
+		current[0] = previous[0] + 1;
+		int row_min = current[0];
+
+		for(size_t i = 1; i < width; ++i)
+		{
+			current[i] = std::min({previous[i] + 1, current[i - 1] + 1, previous[i - 1] + (word[i - 1] == c ? 0 : 1)});
+			row_min = std::min(row_min, current[i]);
+		}
+
+		return row_min <= max_distance;
+	};
+
+	const auto pop = [&]
+	{
+		prefix.pop_back();
+		rows.resize((prefix.size() + 1) * width);
+	};
+
+	// A character outside word only ever raises a row, so when prefix + c is dead, so is
+	// every prefix + (character outside word): the only candidates are larger characters of word.
+	std::string word_chars(word);
+	std::sort(word_chars.begin(), word_chars.end(), [](char lhs, char rhs) { return static_cast<unsigned char>(lhs) < static_cast<unsigned char>(rhs); });
+	word_chars.erase(std::unique(word_chars.begin(), word_chars.end()), word_chars.end());
+
+	// Turns a dead prefix into the smallest larger prefix that is still alive.
+	const auto advance = [&]
+	{
+		while(!prefix.empty())
+		{
+			const auto last = static_cast<unsigned char>(prefix.back());
+			pop();
+
+			if(last == 0xFF)
+			{
+				continue;
+			}
+
+			// last itself may have been alive (when climbing), so its successor is tried first.
+			const auto next = static_cast<unsigned char>(last + 1);
+
+			if(push(static_cast<char>(next)))
+			{
+				return true;
+			}
+
+			pop();
+
+			for(const char c : word_chars)
+			{
+				if(static_cast<unsigned char>(c) <= next)
+				{
+					continue;
+				}
+
+				if(push(c))
+				{
+					return true;
+				}
+
+				pop();
+			}
+		}
+
+		return false;
+	};
+
+	auto it = terms_.begin();
+
+	while(it != terms_.end())
+	{
+		const std::string_view term = *it;
+
+		const size_t common = std::mismatch(prefix.begin(), prefix.end(), term.begin(), term.end()).first - prefix.begin();
+
+		while(prefix.size() > common)
+		{
+			pop();
+		}
+
+		bool is_alive = true;
+
+		while(is_alive && prefix.size() < term.size())
+		{
+			is_alive = push(term[prefix.size()]);
+		}
+
+		if(is_alive)
+		{
+			const int distance = rows[prefix.size() * width + word.size()];
+
+			if(distance <= max_distance)
+			{
+				fn(term, distance);
+			}
+
+			++it;
+			continue;
+		}
+
+		if(!advance())
+		{
+			break;
+		}
+
+		it = terms_.lower_bound(std::string_view(prefix));
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <string_view>
+
+// Owns the text of every indexed word. Views returned by Intern stay valid for the
+// dictionary's lifetime, and since terms are kept sorted every term starting with a
+// prefix is one contiguous run: finding it is a single lower_bound.
+class TermDictionary
+{
+public:
+	explicit TermDictionary(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	std::string_view Intern(std::string_view word);
+
+	bool Contains(std::string_view word) const;
+
+	size_t GetSize() const;
+
+	// Calls fn(term) for each term starting with prefix, in sorted order, until fn returns false.
+	template<typename Fn>
+	void ForEachWithPrefix(std::string_view prefix, Fn fn) const;
+
+	// Calls fn(term, distance) for each term within max_distance edits (Levenshtein) of word.
+	// Walks the terms as a trie: shared prefixes reuse their automaton rows, and once a
+	// prefix can no longer match, every term under it is skipped by one lower_bound.
+	void ForEachWithinDistance(std::string_view word, int max_distance, const std::function<void(std::string_view, int)>& fn) const;
+
+private:
+	std::pmr::set<std::pmr::string, std::less<>> terms_;
+};
+
+template<typename Fn>
+void TermDictionary::ForEachWithPrefix(std::string_view prefix, Fn fn) const
+{
+	for(auto it = terms_.lower_bound(prefix); it != terms_.end(); ++it)
+	{
+		const std::string_view term = *it;
+
+		if(term.substr(0, prefix.size()) != prefix || !fn(term))
+		{
+			break;
+		}
+	}
+}